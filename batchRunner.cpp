@@ -0,0 +1,334 @@
+// batchRunner.cpp plays many boards without a window, each in a World of its own, on a work stealing pool of threads,
+// and streams one CSV row per board as it finishes. It is for tuning lengthRange, colorRange and the board size over thousands of games.
+//
+//   batchRunner [--boards N] [--threads N] [--seed N] [--board COLS ROWS] [--length MIN MAX] [--colors N] [--ticks N] [--soak] [--require-fill] [--out FILE]
+//
+// Board i plays with seed + i, and a board plays out the same whichever thread runs it, so the hash column of a row can be checked
+// against any other run. A board stops at its WorldStats::filledTick or once its last Snake died unless --soak is given, and after --ticks ticks either way.
+// The rows go to FILE, or to stdout without --out, and the totals of the whole batch are printed at the end. Only small boards fill before kills
+// clear them again, peak_fill_pct and ticks_to_peak say how full any board got. With --require-fill the exit code is 2 if a board never filled
+#include "snakeSim.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#ifdef SNAKES_PROFILE
+#error "the profiler is shared by every World in the process, build batchRunner without SNAKES_PROFILE"
+#endif
+
+struct BatchConfig {
+    int          boards;
+    int          threads;
+    unsigned int seed;
+    int          cols;
+    int          rows;
+    double       lengthMin;
+    double       lengthMax;
+    int          colors;
+    int          maxTicks;
+    bool         soak;
+    bool         requireFill;
+};
+
+typedef std::chrono::steady_clock batchClock;
+
+/******************************************
+*          TickHistogram class            *
+*                                         *
+*  how long the ticks took, in buckets    *
+*  four to an octave                      *
+*******************************************/
+
+// Bucket b below 8 holds ticks of exactly b nanoseconds, above that every octave is split into four buckets, so a percentile read
+// off the histogram is at most a quarter too high. Histograms of different boards and threads are merged by adding them up
+struct TickHistogram {
+    static int const BUCKETS = 4 * 48;
+
+    TickHistogram() { clear(); }
+    void clear() {
+        std::fill(counts, counts + BUCKETS, 0LL);
+        ticks = 0;
+        totalNs = 0;
+        maxNs = 0;
+    }
+    void add(long long ns) {
+        ++counts[bucketOf(ns)];
+        ++ticks;
+        totalNs += ns;
+        maxNs = std::max(maxNs, ns);
+    }
+    void merge(const TickHistogram &other) {
+        for (int b = 0; b < BUCKETS; ++b) counts[b] += other.counts[b];
+        ticks += other.ticks;
+        totalNs += other.totalNs;
+        maxNs = std::max(maxNs, other.maxNs);
+    }
+    static int bucketOf(long long ns) {
+        if (ns < 4) return ns < 0 ? 0 : (int)ns;
+        int msb = 2;
+        while ((ns >> (msb + 1)) != 0) ++msb;
+        return std::min((msb - 1) * 4 + (int)((ns >> (msb - 2)) & 3), BUCKETS - 1);
+    }
+    // bucketEnd() is the first nanosecond count past bucket b
+    static long long bucketEnd(int b) {
+        if (b < 4) return b + 1;
+        return (5LL + (b & 3)) << (b / 4 - 1);
+    }
+    // percentileUs() is the end of the bucket the q-th fraction of the ticks falls into, in microseconds
+    double percentileUs(double q) const {
+        long long rank = (long long)(q * ticks);
+        long long seen = 0;
+        for (int b = 0; b < BUCKETS; ++b) {
+            seen += counts[b];
+            if (seen > rank) return std::min(bucketEnd(b), maxNs) / 1000.0;
+        }
+        return maxNs / 1000.0;
+    }
+    double meanUs() const { return ticks > 0 ? totalNs / 1000.0 / ticks : 0; }
+
+    long long counts[BUCKETS];
+    long long ticks;
+    long long totalNs;
+    long long maxNs;
+};
+
+/******************************************
+*          StealingPool class             *
+*                                         *
+*  runs the boards, idle threads take     *
+*  work from busy ones                    *
+*******************************************/
+
+// one thread's share of the boards, its owner takes them from the front and the other threads steal from the back
+struct TaskDeque {
+    std::mutex      mutex;
+    std::deque<int> tasks;
+};
+
+// what one thread added up over the boards it played, merged into the batch totals when it is done
+struct BatchTotals {
+    BatchTotals() : boards(0), filled(0), fillTicks(0), peakFill(0), peakTicks(0), spawns(0) { std::fill(kills, kills + SNAKE_COLOR_COUNT, 0LL); }
+
+    TickHistogram tickTimes;
+    long long     boards;
+    long long     filled;
+    long long     fillTicks;
+    double        peakFill;
+    long long     peakTicks;
+    long long     spawns;
+    long long     kills[SNAKE_COLOR_COUNT];
+};
+
+// Every thread starts out with one contiguous run of boards in its own TaskDeque. Boards take very different numbers of ticks to fill,
+// so threads run dry at different times, and one that did steals the last board of another thread's run instead of sitting idle.
+// No board ever adds boards, so a thread that finds every TaskDeque empty is done
+struct StealingPool {
+    StealingPool(const BatchConfig &config, std::ostream &out);
+    void run();
+
+private:
+    void work(int self);
+    bool takeTask(int self, int &task);
+    void playBoard(World &world, int board, BatchTotals &threadTotals, TickHistogram &boardTicks);
+
+    const BatchConfig &    config;
+    std::ostream &         out;
+    std::mutex             outMutex;
+    std::vector<TaskDeque> deques;
+
+public:
+    BatchTotals            totals;
+};
+
+StealingPool::StealingPool(const BatchConfig &config, std::ostream &out) : config(config), out(out), deques(config.threads) {
+    for (int t = 0; t < config.threads; ++t) {
+        int first = (int)((long long)config.boards * t / config.threads);
+        int last = (int)((long long)config.boards * (t + 1) / config.threads);
+        for (int board = first; board < last; ++board) deques[t].tasks.push_back(board);
+    }
+}
+
+void StealingPool::run() {
+    std::vector<std::thread> threads;
+    for (int t = 1; t < config.threads; ++t) {
+        threads.push_back(std::thread(&StealingPool::work, this, t));
+    }
+    work(0);
+    for (auto it = threads.begin(); it != threads.end(); ++it) {
+        it->join();
+    }
+}
+
+// takeTask() pops the front of self's TaskDeque, or when that is empty the back of the next thread's that isn't
+bool StealingPool::takeTask(int self, int &task) {
+    for (int i = 0; i < config.threads; ++i) {
+        TaskDeque &deque = deques[(self + i) % config.threads];
+        std::lock_guard<std::mutex> lock(deque.mutex);
+        if (deque.tasks.empty()) continue;
+        if (i == 0) {
+            task = deque.tasks.front();
+            deque.tasks.pop_front();
+        } else {
+            task = deque.tasks.back();
+            deque.tasks.pop_back();
+        }
+        return true;
+    }
+    return false;
+}
+
+// each thread plays all its boards in one World, resetSimulation() clears everything a board left behind
+void StealingPool::work(int self) {
+    World world;
+    BatchTotals threadTotals;
+    TickHistogram boardTicks;
+    int board;
+    while (takeTask(self, board)) {
+        playBoard(world, board, threadTotals, boardTicks);
+    }
+
+    std::lock_guard<std::mutex> lock(outMutex);
+    totals.tickTimes.merge(threadTotals.tickTimes);
+    totals.boards += threadTotals.boards;
+    totals.filled += threadTotals.filled;
+    totals.fillTicks += threadTotals.fillTicks;
+    totals.peakFill += threadTotals.peakFill;
+    totals.peakTicks += threadTotals.peakTicks;
+    totals.spawns += threadTotals.spawns;
+    for (int color = 0; color < SNAKE_COLOR_COUNT; ++color) totals.kills[color] += threadTotals.kills[color];
+}
+
+void StealingPool::playBoard(World &world, int board, BatchTotals &threadTotals, TickHistogram &boardTicks) {
+    unsigned int seed = config.seed + (unsigned int)board;
+    world.lengthRange = std::uniform_real_distribution <double>(config.lengthMin, config.lengthMax);
+    world.colorRange = std::uniform_real_distribution <double>(0, config.colors);
+    world.resetSimulation(seed, config.cols, config.rows);
+    world.snakeMasterVec.push_back(Snake(world));
+
+    boardTicks.clear();
+    for (int tick = 0; tick < config.maxTicks; ++tick) {
+        batchClock::time_point start = batchClock::now();
+        world.gameTick();
+        boardTicks.add(std::chrono::duration_cast<std::chrono::nanoseconds>(batchClock::now() - start).count());
+        //a filled board has nothing more to tell, and one with no Snakes left stays as it is from here on
+        if (!config.soak && (world.stats.filledTick >= 0 || world.snakeCount() == 0)) break;
+    }
+
+    const WorldStats &stats = world.stats;
+    double peakFill = 100.0 * stats.peakCells / ((double)config.cols * config.rows);
+    threadTotals.tickTimes.merge(boardTicks);
+    ++threadTotals.boards;
+    if (stats.filledTick >= 0) {
+        ++threadTotals.filled;
+        threadTotals.fillTicks += stats.filledTick;
+    }
+    threadTotals.peakFill += peakFill;
+    threadTotals.peakTicks += stats.peakTick;
+    threadTotals.spawns += stats.spawns;
+    for (int color = 0; color < SNAKE_COLOR_COUNT; ++color) threadTotals.kills[color] += stats.kills[color];
+
+    std::lock_guard<std::mutex> lock(outMutex);
+    out << board << ',' << seed << ',' << config.cols << ',' << config.rows << ',' << world.tickNumber << ',' << stats.filledTick << ','
+        << peakFill << ',' << stats.peakTick << ',' << stats.spawns << ',' << world.snakeCount() << ',' << world.frozenLayer.frozen.size();
+    for (int color = 0; color < SNAKE_COLOR_COUNT; ++color) out << ',' << stats.kills[color];
+    out << ',' << boardTicks.meanUs() << ',' << boardTicks.percentileUs(0.5) << ',' << boardTicks.percentileUs(0.9) << ','
+        << boardTicks.percentileUs(0.99) << ',' << boardTicks.maxNs / 1000.0 << ',' << std::hex << world.simulationHash() << std::dec << '\n';
+    out.flush();
+}
+
+/******************************************
+*                 main                    *
+*******************************************/
+
+int main(int argc, char* argv[]) {
+    BatchConfig config;
+    config.boards = 100;
+    config.threads = std::max(1, (int)std::thread::hardware_concurrency());
+    config.seed = 1;
+    config.cols = 20;
+    config.rows = 32;
+    config.lengthMin = 3;
+    config.lengthMax = 10;
+    config.colors = SNAKE_COLOR_COUNT;
+    config.maxTicks = 100000;
+    config.soak = false;
+    config.requireFill = false;
+    std::string outName;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--boards" && i + 1 < argc) {
+            config.boards = std::stoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            config.threads = std::stoi(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            config.seed = (unsigned int)std::stoul(argv[++i]);
+        } else if (arg == "--board" && i + 2 < argc) {
+            config.cols = std::stoi(argv[++i]);
+            config.rows = std::stoi(argv[++i]);
+        } else if (arg == "--length" && i + 2 < argc) {
+            config.lengthMin = std::stod(argv[++i]);
+            config.lengthMax = std::stod(argv[++i]);
+        } else if (arg == "--colors" && i + 1 < argc) {
+            config.colors = std::stoi(argv[++i]);
+        } else if (arg == "--ticks" && i + 1 < argc) {
+            config.maxTicks = std::stoi(argv[++i]);
+        } else if (arg == "--soak") {
+            config.soak = true;
+        } else if (arg == "--require-fill") {
+            config.requireFill = true;
+        } else if (arg == "--out" && i + 1 < argc) {
+            outName = argv[++i];
+        } else {
+            std::cout << "unknown argument " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (config.boards < 1 || config.threads < 1 || config.cols < 1 || config.rows < 1 || config.maxTicks < 1
+        || config.lengthMin < 2 || config.lengthMax <= config.lengthMin || config.colors < 1 || config.colors > SNAKE_COLOR_COUNT) {
+        std::cout << "boards, threads, board size and ticks have to be at least 1, lengths at least 2 and colors 1 to " << SNAKE_COLOR_COUNT << std::endl;
+        return 1;
+    }
+    config.threads = std::min(config.threads, config.boards);
+
+    std::ofstream outFile;
+    if (!outName.empty()) {
+        outFile.open(outName.c_str(), std::ios::trunc);
+        if (!outFile) {
+            std::cout << "ERROR: can't write " << outName << std::endl;
+            return 1;
+        }
+    }
+    std::ostream &out = outFile.is_open() ? outFile : std::cout;
+    //with the rows on stdout the totals go to stderr, so stdout stays plain CSV
+    std::ostream &log = outFile.is_open() ? std::cout : std::cerr;
+
+    out << "board,seed,cols,rows,ticks,ticks_to_fill,peak_fill_pct,ticks_to_peak,spawned,alive,frozen,kills_green,kills_blue,kills_red,"
+           "tick_us_mean,tick_us_p50,tick_us_p90,tick_us_p99,tick_us_max,hash\n";
+    StealingPool pool(config, out);
+    batchClock::time_point start = batchClock::now();
+    pool.run();
+    std::chrono::duration<double> elapsed = batchClock::now() - start;
+
+    const BatchTotals &totals = pool.totals;
+    double seconds = elapsed.count();
+    log << totals.boards << " boards of " << config.cols << "x" << config.rows << " on " << config.threads << " threads in " << seconds << " s, "
+        << (seconds > 0 ? totals.boards / seconds : 0) << " boards/sec, " << (seconds > 0 ? totals.tickTimes.ticks / seconds : 0) << " ticks/sec" << std::endl;
+    log << "filled: " << totals.filled << " of " << totals.boards << " boards, mean ticks to fill "
+        << (totals.filled > 0 ? (double)totals.fillTicks / totals.filled : 0) << ", mean peak fill " << totals.peakFill / totals.boards
+        << "% after " << (double)totals.peakTicks / totals.boards << " ticks" << std::endl;
+    log << "spawned: " << totals.spawns << ", kills green/blue/red: " << totals.kills[GREEN] << " / " << totals.kills[BLUE] << " / " << totals.kills[RED] << std::endl;
+    log << "tick us mean " << totals.tickTimes.meanUs() << ", p50 " << totals.tickTimes.percentileUs(0.5) << ", p90 " << totals.tickTimes.percentileUs(0.9)
+        << ", p99 " << totals.tickTimes.percentileUs(0.99) << ", max " << totals.tickTimes.maxNs / 1000.0 << std::endl;
+    if (config.requireFill && totals.filled < totals.boards) {
+        log << "ERROR: " << totals.boards - totals.filled << " boards never filled" << std::endl;
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,229 @@
+// benchmark.cpp times the tick hot paths of snakeSim one at a time on synthetic boards and prints the results as JSON.
+//
+//   benchmark                                       runs the default sweep from the 20x32 window board up to 1000x1000
+//   benchmark --cols N --rows N --snakes N --length N [--iterations N] [--seed N]   runs a single board
+#include "snakeSim.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+
+struct BenchConfig {
+    int          cols;
+    int          rows;
+    int          snakes;
+    int          length;
+    int          iterations;
+    unsigned int seed;
+};
+
+struct BenchResult {
+    std::string name;
+    BenchConfig config;
+    int         snakesPlaced;
+    long long   operations;
+    double      nsPerOp;
+    double      bestNsPerOp;
+};
+
+std::vector<BenchResult> results;
+
+//every benchmark lays its board out again in this one World
+World world;
+
+typedef std::chrono::steady_clock benchClock;
+
+double elapsedNs(benchClock::time_point start) {
+    return std::chrono::duration<double, std::nano>(benchClock::now() - start).count();
+}
+
+// layBoard() starts a fresh simulation and stands config.snakes Snakes upright in the columns, head at the bottom,
+// one every bandHeight rows. A bandHeight of config.length packs them tight, anything more leaves room below each head.
+// Returns how many Snakes fit on the board
+int layBoard(const BenchConfig &config, int bandHeight) {
+    world.lengthRange = std::uniform_real_distribution <double>(config.length, config.length + 1);
+    world.resetSimulation(config.seed, config.cols, config.rows);
+
+    PartStore &partStore = world.partStore;
+    int bands = config.rows / bandHeight;
+    int count = std::min(config.snakes, bands * config.cols);
+    world.snakeMasterVec.reserve(count);
+    for (int k = 0; k < count; ++k) {
+        world.snakeMasterVec.push_back(Snake(world));
+        Snake &snake = world.snakeMasterVec.back();
+        int x = k % config.cols;
+        int y = (k / config.cols) * bandHeight + config.length - 1;
+        for (int i = 0; i < snake.length; ++i) {
+            int p = snake.part(i);
+            world.occupancyGrid.vacate(partStore.cellX[p], partStore.cellY[p], snake.id);
+            partStore.cellX[p] = (int16_t)x;
+            partStore.cellY[p] = (int16_t)(y - i);
+            world.occupancyGrid.occupy(x, y - i, snake.id, snake.color);
+        }
+    }
+    return count;
+}
+
+void record(const std::string &name, const BenchConfig &config, int placed, long long operations, double totalNs, double bestPassNs, long long opsPerPass) {
+    BenchResult result;
+    result.name = name;
+    result.config = config;
+    result.snakesPlaced = placed;
+    result.operations = operations;
+    result.nsPerOp = operations > 0 ? totalNs / operations : 0;
+    result.bestNsPerOp = opsPerPass > 0 ? bestPassNs / opsPerPass : 0;
+    results.push_back(result);
+}
+
+// benchCollision() times collisionSnakeCheck() for every Snake of a tightly packed board, where most probes hit something.
+// The check only fills in a MoveIntent, so every pass sees the same board
+void benchCollision(const BenchConfig &config) {
+    int placed = layBoard(config, config.length);
+    MoveIntent intent;
+    double total = 0;
+    double best = 1e300;
+    for (int pass = 0; pass < config.iterations; ++pass) {
+        auto start = benchClock::now();
+        for (auto it = world.snakeMasterVec.begin(); it != world.snakeMasterVec.end(); ++it) {
+            it->collisionSnakeCheck(intent);
+        }
+        double ns = elapsedNs(start);
+        total += ns;
+        best = std::min(best, ns);
+    }
+    record("collisionSnakeCheck", config, placed, (long long)placed * config.iterations, total, best, placed);
+}
+
+// benchMove() times move() (which calls orient()) for every Snake, with room under every head for all of the passes
+void benchMove(const BenchConfig &config) {
+    int passes = std::max(1, std::min(config.iterations, config.rows - config.length));
+    int placed = layBoard(config, config.length + passes);
+    double total = 0;
+    double best = 1e300;
+    for (int pass = 0; pass < passes; ++pass) {
+        auto start = benchClock::now();
+        for (auto it = world.snakeMasterVec.begin(); it != world.snakeMasterVec.end(); ++it) {
+            it->move();
+        }
+        double ns = elapsedNs(start);
+        total += ns;
+        best = std::min(best, ns);
+    }
+    record("move", config, placed, (long long)placed * passes, total, best, placed);
+}
+
+// benchKill() times killSnakes() with every fourth Snake marked to die, laying the board out again between passes
+void benchKill(const BenchConfig &config) {
+    double total = 0;
+    double best = 1e300;
+    long long killed = 0;
+    int placed = 0;
+    long long perPass = 0;
+    for (int pass = 0; pass < config.iterations; ++pass) {
+        placed = layBoard(config, config.length);
+        perPass = 0;
+        for (int k = 0; k < placed; k += 4) {
+            world.snakeMasterVec[k].dieNextTick = true;
+            ++perPass;
+        }
+        auto start = benchClock::now();
+        world.killSnakes();
+        double ns = elapsedNs(start);
+        total += ns;
+        best = std::min(best, ns);
+        killed += perPass;
+    }
+    record("killSnakes", config, placed, killed, total, best, perPass);
+}
+
+// benchSpawn() times constructing and appending config.snakes new Snakes to an empty board
+void benchSpawn(const BenchConfig &config) {
+    double total = 0;
+    double best = 1e300;
+    for (int pass = 0; pass < config.iterations; ++pass) {
+        layBoard(config, config.rows + 1);
+        auto start = benchClock::now();
+        for (int k = 0; k < config.snakes; ++k) {
+            world.snakeMasterVec.emplace_back(world);
+        }
+        double ns = elapsedNs(start);
+        total += ns;
+        best = std::min(best, ns);
+    }
+    record("spawn", config, config.snakes, (long long)config.snakes * config.iterations, total, best, config.snakes);
+}
+
+void runBoard(const BenchConfig &config) {
+    std::cerr << "benchmarking " << config.cols << "x" << config.rows << " board, " << config.snakes << " snakes of length " << config.length << std::endl;
+    benchCollision(config);
+    benchMove(config);
+    benchKill(config);
+    benchSpawn(config);
+}
+
+void printJson() {
+    std::cout << "[" << std::endl;
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult &r = results[i];
+        std::cout << "  {\"benchmark\": \"" << r.name << "\""
+                  << ", \"cols\": " << r.config.cols
+                  << ", \"rows\": " << r.config.rows
+                  << ", \"snakes\": " << r.snakesPlaced
+                  << ", \"length\": " << r.config.length
+                  << ", \"seed\": " << r.config.seed
+                  << ", \"operations\": " << r.operations
+                  << ", \"ns_per_op\": " << r.nsPerOp
+                  << ", \"best_ns_per_op\": " << r.bestNsPerOp
+                  << "}" << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    std::cout << "]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    config.cols = 0;
+    config.rows = 0;
+    config.snakes = 0;
+    config.length = 6;
+    config.iterations = 20;
+    config.seed = 1;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        int value = std::atoi(argv[i + 1]);
+        if (arg == "--cols") config.cols = value;
+        else if (arg == "--rows") config.rows = value;
+        else if (arg == "--snakes") config.snakes = value;
+        else if (arg == "--length") config.length = value;
+        else if (arg == "--iterations") config.iterations = value;
+        else if (arg == "--seed") config.seed = (unsigned int)value;
+        else {
+            std::cerr << "unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (config.length < 3 || config.iterations < 1) {
+        std::cerr << "--length has to be at least 3 and --iterations at least 1" << std::endl;
+        return 1;
+    }
+
+    if (config.cols > 0 && config.rows > 0) {
+        if (config.snakes <= 0) config.snakes = config.cols * config.rows / (2 * config.length);
+        runBoard(config);
+    } else {
+        // the window board first, then bigger boards about half full of snakes
+        int const sweep[][2] = { { 20, 32 }, { 100, 100 }, { 316, 316 }, { 1000, 1000 } };
+        for (int b = 0; b < 4; ++b) {
+            BenchConfig board = config;
+            board.cols = sweep[b][0];
+            board.rows = sweep[b][1];
+            board.snakes = board.cols * board.rows / (2 * board.length);
+            runBoard(board);
+        }
+    }
+
+    printJson();
+    return 0;
+}
@@ -0,0 +1,305 @@
+#include "frameCapture.h"
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+
+bool parseCaptureFormat(const std::string &name, int &format) {
+    char const *const names[CAPTURE_FORMAT_COUNT] = { "raw", "png", "y4m" };
+    for (int f = 0; f < CAPTURE_FORMAT_COUNT; ++f) {
+        if (name == names[f]) {
+            format = f;
+            return true;
+        }
+    }
+    return false;
+}
+
+/******************************************
+*             png encoding                *
+*******************************************/
+
+// the png crc32 of every byte value, built once by whichever encoder needs it first
+struct CrcTable {
+    CrcTable() {
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            entries[n] = c;
+        }
+    }
+    uint32_t entries[256];
+};
+
+static uint32_t crc32(const unsigned char *data, size_t size) {
+    static const CrcTable table;
+    uint32_t c = 0xffffffffu;
+    for (size_t i = 0; i < size; ++i) c = table.entries[(c ^ data[i]) & 0xff] ^ (c >> 8);
+    return c ^ 0xffffffffu;
+}
+
+static uint32_t adler32(const unsigned char *data, size_t size) {
+    uint32_t a = 1, b = 0;
+    while (size > 0) {
+        // 5552 bytes is the most that can be summed before b could overflow
+        size_t run = size < 5552 ? size : 5552;
+        for (size_t i = 0; i < run; ++i) {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += run;
+        size -= run;
+    }
+    return (b << 16) | a;
+}
+
+static void putBigEndian(std::vector<unsigned char> &out, uint32_t value) {
+    out.push_back((unsigned char)(value >> 24));
+    out.push_back((unsigned char)(value >> 16));
+    out.push_back((unsigned char)(value >> 8));
+    out.push_back((unsigned char)value);
+}
+
+// pngChunk() appends a chunk of the given type around size bytes of data
+static void pngChunk(std::vector<unsigned char> &out, char const *type, const unsigned char *data, size_t size) {
+    putBigEndian(out, (uint32_t)size);
+    size_t typeStart = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+    putBigEndian(out, crc32(&out[typeStart], size + 4));
+}
+
+// encodePng() writes an 8 bit RGB png of pixels into out. The image data goes into stored deflate blocks, which needs no zlib and costs
+// about as much as copying the frame. Run the pngs through optipng or ffmpeg when their size matters more than the time it takes to write them
+static void encodePng(const CapturedFrame &frame, int width, int height, std::vector<unsigned char> &scanlines, std::vector<unsigned char> &out) {
+    size_t rowBytes = (size_t)width * 3 + 1;
+    scanlines.resize(rowBytes * height);
+    for (int y = 0; y < height; ++y) {
+        unsigned char *row = &scanlines[rowBytes * y];
+        const uint32_t *pixel = &frame.pixels[(size_t)width * y];
+        *row++ = 0;
+        for (int x = 0; x < width; ++x) {
+            *row++ = (unsigned char)(pixel[x] >> 16);
+            *row++ = (unsigned char)(pixel[x] >> 8);
+            *row++ = (unsigned char)pixel[x];
+        }
+    }
+
+    static unsigned char const signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    out.assign(signature, signature + 8);
+    unsigned char header[13] = { 0 };
+    for (int i = 0; i < 4; ++i) {
+        header[i] = (unsigned char)(width >> (24 - i * 8));
+        header[4 + i] = (unsigned char)(height >> (24 - i * 8));
+    }
+    header[8] = 8;
+    header[9] = 2;
+    pngChunk(out, "IHDR", header, sizeof(header));
+
+    // the IDAT chunk is built in place, its length goes in once the zlib stream is done
+    size_t idatStart = out.size();
+    putBigEndian(out, 0);
+    out.insert(out.end(), "IDAT", "IDAT" + 4);
+    out.push_back(0x78);
+    out.push_back(0x01);
+    size_t left = scanlines.size();
+    const unsigned char *data = scanlines.data();
+    do {
+        size_t block = left < 65535 ? left : 65535;
+        out.push_back(block == left ? 1 : 0);
+        out.push_back((unsigned char)block);
+        out.push_back((unsigned char)(block >> 8));
+        out.push_back((unsigned char)~block);
+        out.push_back((unsigned char)(~block >> 8));
+        out.insert(out.end(), data, data + block);
+        data += block;
+        left -= block;
+    } while (left > 0);
+    putBigEndian(out, adler32(scanlines.data(), scanlines.size()));
+    uint32_t idatSize = (uint32_t)(out.size() - idatStart - 8);
+    for (int i = 0; i < 4; ++i) out[idatStart + i] = (unsigned char)(idatSize >> (24 - i * 8));
+    putBigEndian(out, crc32(&out[idatStart + 4], idatSize + 4));
+
+    pngChunk(out, "IEND", nullptr, 0);
+}
+
+/******************************************
+*             y4m encoding                *
+*******************************************/
+
+// encodeY4m() writes one FRAME of a C444 y4m stream into out, the pixels converted to BT.601 video range YCbCr the way ffmpeg reads y4m
+static void encodeY4m(const CapturedFrame &frame, int width, int height, std::vector<unsigned char> &out) {
+    size_t planeSize = (size_t)width * height;
+    out.resize(6 + planeSize * 3);
+    std::memcpy(&out[0], "FRAME\n", 6);
+    unsigned char *luma = &out[6];
+    unsigned char *cb = luma + planeSize;
+    unsigned char *cr = cb + planeSize;
+    for (size_t i = 0; i < planeSize; ++i) {
+        int r = (frame.pixels[i] >> 16) & 0xff;
+        int g = (frame.pixels[i] >> 8) & 0xff;
+        int b = frame.pixels[i] & 0xff;
+        luma[i] = (unsigned char)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        cb[i] = (unsigned char)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+        cr[i] = (unsigned char)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+}
+
+/******************************************
+*          FrameCapture class             *
+*******************************************/
+
+FrameCapture::FrameCapture() {
+    format = CAPTURE_PNG;
+    width = 0;
+    height = 0;
+    framesWritten = 0;
+    producerWaits = 0;
+    failed = false;
+    submitted = 0;
+    nextWrite = 0;
+    closing = false;
+}
+
+FrameCapture::~FrameCapture() {
+    if (!encoders.empty()) finish();
+}
+
+// start() opens the y4m stream if there is one, sets up queueFrames frames of width x height and starts encoderCount encoder threads.
+// The y4m stream plays at fpsNumerator / fpsDenominator frames per second
+bool FrameCapture::start(int captureFormat, const std::string &outputName, int frameWidth, int frameHeight,
+                         int fpsNumerator, int fpsDenominator, int queueFrames, int encoderCount) {
+    format = captureFormat;
+    output = outputName;
+    width = frameWidth;
+    height = frameHeight;
+    if (format == CAPTURE_Y4M) {
+        stream.open(output.c_str(), std::ios::binary | std::ios::trunc);
+        stream << "YUV4MPEG2 W" << width << " H" << height << " F" << fpsNumerator << ":" << fpsDenominator << " Ip A1:1 C444\n";
+        if (!stream) {
+            std::cout << "ERROR: can't write " << output << std::endl;
+            return false;
+        }
+    }
+
+    frames.resize(queueFrames);
+    for (auto it = frames.begin(); it != frames.end(); ++it) {
+        it->pixels.resize((size_t)width * height);
+        freeFrames.push_back(&*it);
+    }
+    for (int e = 0; e < encoderCount; ++e) {
+        encoders.push_back(std::thread(&FrameCapture::encodeLoop, this));
+    }
+    return true;
+}
+
+// nextFree() returns a frame for the render thread to fill, waiting for an encoder to hand one back when there is none
+CapturedFrame * FrameCapture::nextFree() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (freeFrames.empty()) {
+        ++producerWaits;
+        frameFreed.wait(lock, [this] { return !freeFrames.empty(); });
+    }
+    CapturedFrame *frame = freeFrames.back();
+    freeFrames.pop_back();
+    frame->index = submitted++;
+    return frame;
+}
+
+void FrameCapture::submit(CapturedFrame *frame) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queued.push_back(frame);
+    }
+    frameQueued.notify_one();
+}
+
+// finish() lets the encoders write everything still queued, stops them and returns whether every frame was written
+bool FrameCapture::finish() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    frameQueued.notify_all();
+    for (auto it = encoders.begin(); it != encoders.end(); ++it) {
+        it->join();
+    }
+    encoders.clear();
+    if (stream.is_open()) {
+        stream.close();
+        if (!stream) {
+            std::cout << "ERROR: can't write " << output << std::endl;
+            failed = true;
+        }
+    }
+    return !failed;
+}
+
+// encodeLoop() is one encoder thread: it takes the oldest queued frame, encodes and writes it and frees it, until finish() was called and nothing is left
+void FrameCapture::encodeLoop() {
+    std::vector<unsigned char> scratch;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        frameQueued.wait(lock, [this] { return closing || !queued.empty(); });
+        if (queued.empty()) return;
+        CapturedFrame *frame = queued.front();
+        queued.pop_front();
+        lock.unlock();
+
+        encode(*frame, scratch);
+        bool written;
+        if (format == CAPTURE_Y4M) {
+            // frames are queued in index order, so the frame nextWrite waits for is already with another encoder
+            lock.lock();
+            frameWritten.wait(lock, [this, frame] { return nextWrite == frame->index; });
+            lock.unlock();
+            written = write(*frame);
+            lock.lock();
+            ++nextWrite;
+            frameWritten.notify_all();
+        } else {
+            written = write(*frame);
+            lock.lock();
+        }
+
+        if (written) {
+            ++framesWritten;
+        } else {
+            failed = true;
+        }
+        freeFrames.push_back(frame);
+        frameFreed.notify_one();
+    }
+}
+
+void FrameCapture::encode(CapturedFrame &frame, std::vector<unsigned char> &scratch) {
+    if (format == CAPTURE_PNG) {
+        encodePng(frame, width, height, scratch, frame.encoded);
+    } else if (format == CAPTURE_Y4M) {
+        encodeY4m(frame, width, height, frame.encoded);
+    }
+}
+
+// write() appends a y4m frame to the stream, or writes a raw or png frame to a file of its own
+bool FrameCapture::write(CapturedFrame &frame) {
+    if (format == CAPTURE_Y4M) {
+        stream.write((const char *)frame.encoded.data(), frame.encoded.size());
+        return (bool)stream;
+    }
+
+    char number[32];
+    std::snprintf(number, sizeof(number), "-%06llu", (unsigned long long)frame.index);
+    std::string file = output + number + (format == CAPTURE_PNG ? ".png" : ".raw");
+    std::ofstream out(file.c_str(), std::ios::binary | std::ios::trunc);
+    if (format == CAPTURE_PNG) {
+        out.write((const char *)frame.encoded.data(), frame.encoded.size());
+    } else {
+        out.write((const char *)frame.pixels.data(), frame.pixels.size() * sizeof(uint32_t));
+    }
+    if (!out) {
+        std::cout << "ERROR: can't write " << file << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+// frameCapture.h takes the frames the game renders offscreen and writes them out on a pool of encoder threads, as numbered raw or png files
+// or as one y4m stream for ffmpeg. The thread that renders only copies pixels into a free CapturedFrame and queues it, so it runs as fast
+// as the simulation and the encoders allow instead of at the game's tick rate
+#include <vector>
+#include <deque>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+// CAPTURE_RAW writes <output>-000000.raw and on, every frame as height rows of width ARGB8888 words, little endian (ffmpeg's bgra).
+// CAPTURE_PNG writes <output>-000000.png and on, CAPTURE_Y4M writes every frame into the single file <output>
+enum captureFormats { CAPTURE_RAW, CAPTURE_PNG, CAPTURE_Y4M, CAPTURE_FORMAT_COUNT };
+
+// parseCaptureFormat() turns "raw", "png" or "y4m" into one of the captureFormats, false for anything else
+bool parseCaptureFormat(const std::string &name, int &format);
+
+/******************************************
+*          FrameCapture class             *
+*                                         *
+*  a bounded queue of rendered frames     *
+*  and the threads that encode them       *
+*******************************************/
+
+// one rendered frame, index counts the captured frames from 0. encoded is the encoder's scratch and keeps its memory between frames
+struct CapturedFrame {
+    uint64_t                   index;
+    std::vector<uint32_t>      pixels;
+    std::vector<unsigned char> encoded;
+};
+
+// There are queueFrames CapturedFrames and no more. The render thread takes a free one with nextFree(), fills pixels and submit()s it,
+// an encoder takes it from the front of queued, writes it and hands it back to freeFrames. When every frame is queued or being encoded
+// nextFree() waits, so a capture uses a fixed amount of memory however far the encoders fall behind, and producerWaits says how often that happened.
+// The y4m stream has to be written in order, encoders convert their frames at the same time but wait for nextWrite to reach theirs before writing
+struct FrameCapture {
+    FrameCapture();
+    ~FrameCapture();
+    bool start(int format, const std::string &output, int width, int height, int fpsNumerator, int fpsDenominator, int queueFrames, int encoderCount);
+    CapturedFrame *nextFree();
+    void submit(CapturedFrame *frame);
+    bool finish();
+
+    int                         format;
+    std::string                 output;
+    int                         width;
+    int                         height;
+    long long                   framesWritten;
+    long long                   producerWaits;
+    bool                        failed;
+
+private:
+    void encodeLoop();
+    void encode(CapturedFrame &frame, std::vector<unsigned char> &scratch);
+    bool write(CapturedFrame &frame);
+
+    std::mutex                  mutex;
+    std::condition_variable     frameFreed;
+    std::condition_variable     frameQueued;
+    std::condition_variable     frameWritten;
+    std::vector<CapturedFrame>  frames;
+    std::vector<CapturedFrame*> freeFrames;
+    std::deque<CapturedFrame*>  queued;
+    std::vector<std::thread>    encoders;
+    std::ofstream               stream;
+    uint64_t                    submitted;
+    uint64_t                    nextWrite;
+    bool                        closing;
+};
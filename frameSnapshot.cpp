@@ -0,0 +1,179 @@
+#include "frameSnapshot.h"
+#include "spriteBundle.h"
+#include <algorithm>
+
+/******************************************
+*          FrameSnapshot class            *
+*******************************************/
+
+FrameSnapshot::FrameSnapshot() {
+    sequence = 0;
+    tickNumber = 0;
+    boardCols = 0;
+    boardRows = 0;
+    chunkCols = 0;
+    chunkRows = 0;
+}
+
+// copyChangedChunks() brings layer up to date with from, copying only the chunks whose version differs. A chunk's vector keeps its memory
+static void copyChangedChunks(PartLayer &layer, const PartLayer &from) {
+    if (layer.chunks.size() != from.chunks.size()) {
+        layer.chunks.assign(from.chunks.size(), std::vector<DrawnPart>());
+        layer.versions.assign(from.versions.size(), 0);
+    }
+    for (size_t c = 0; c < from.chunks.size(); ++c) {
+        if (layer.versions[c] == from.versions[c]) continue;
+        layer.chunks[c] = from.chunks[c];
+        layer.versions[c] = from.versions[c];
+    }
+}
+
+// drawnPart() is SnakePart i of snake, which sits in PartStore slot p, as the renderer draws it
+static DrawnPart drawnPart(const World &world, const Snake &snake, int i, int p) {
+    const PartStore &partStore = world.partStore;
+    int sprite = i == 0 ? HEAD_SPRITE : (i == snake.length - 1 ? TAIL_SPRITE : BODY_SPRITE);
+    DrawnPart drawn;
+    drawn.x = partStore.cellX[p];
+    drawn.y = partStore.cellY[p];
+    drawn.frame = (uint16_t)spriteFrame(snake.color, sprite, stateDirection(partStore.state[p]), stateCorner(partStore.state[p]));
+    return drawn;
+}
+
+// build() copies world's board as it is now, on the simulation thread between ticks, and takes the dirtyCells and the frozen layer's
+// changedCells collected since the last build. boardParts only places the parts in the dirty cells again, and the whole board when it was
+// made for another board size, the World doesn't track its dirty cells or its tickNumber went back, which only a reset or a loaded snapshot does
+void FrameSnapshot::build(World &world, uint64_t seq, BoardParts &boardParts) {
+    sequence = seq;
+    tickNumber = world.tickNumber;
+    boardCols = world.boardCols;
+    boardRows = world.boardRows;
+    chunkCols = (boardCols + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+    chunkRows = (boardRows + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+
+    FrozenLayer &frozenLayer = world.frozenLayer;
+    dirtyChunks.clear();
+    frozenDirtyChunks.clear();
+    markChunks(frozenDirtyChunks, frozenLayer.changedCells);
+    world.dirtyCells.insert(world.dirtyCells.end(), frozenLayer.changedCells.begin(), frozenLayer.changedCells.end());
+    markChunks(dirtyChunks, world.dirtyCells);
+    world.dirtyCells.clear();
+    frozenLayer.changedCells.clear();
+
+    uint64_t version = ++boardParts.builds;
+    if (boardParts.boardCols != boardCols || boardParts.boardRows != boardRows || !world.trackDirtyCells || world.tickNumber < boardParts.tickNumber) {
+        placeParts(world, boardParts.active, world.snakeMasterVec.begin(), world.snakeMasterVec.end(), version);
+        placeParts(world, boardParts.frozen, frozenLayer.frozen.begin(), frozenLayer.frozen.end(), version);
+        boardParts.boardCols = boardCols;
+        boardParts.boardRows = boardRows;
+    } else {
+        placeDirtyCells(world, boardParts.active, dirtyChunks, version, boardParts.occupants, [&world](int id) { return world.snakeById(id); });
+        placeDirtyCells(world, boardParts.frozen, frozenDirtyChunks, version, boardParts.occupants, [&frozenLayer](int id) { return frozenLayer.find(id); });
+    }
+    boardParts.tickNumber = world.tickNumber;
+    copyChangedChunks(active, boardParts.active);
+    copyChangedChunks(frozen, boardParts.frozen);
+}
+
+// placeParts() fills layer with the on board parts of the Snakes in [first, last), in id order and head to tail, and marks every chunk changed in version
+template <typename SnakeIt>
+void FrameSnapshot::placeParts(const World &world, PartLayer &layer, SnakeIt first, SnakeIt last, uint64_t version) {
+    const PartStore &partStore = world.partStore;
+    int chunkCount = chunkCols * chunkRows;
+    layer.chunks.resize(chunkCount);
+    layer.versions.assign(chunkCount, version);
+    for (int c = 0; c < chunkCount; ++c) {
+        layer.chunks[c].clear();
+    }
+    for (SnakeIt it = first; it != last; ++it) {
+        const Snake &snake = *it;
+        if (snake.slot < 0) continue;
+        for (int i = 0; i < snake.length; ++i) {
+            int p = snake.part(i);
+            int x = partStore.cellX[p];
+            int y = partStore.cellY[p];
+            if (x < 0 || x >= boardCols || y < 0 || y >= boardRows) continue;
+            layer.chunks[chunkOf(x, y)].push_back(drawnPart(world, snake, i, p));
+        }
+    }
+}
+
+// placeDirtyCells() takes the parts in the dirty cells of chunks out of layer and puts in the ones there now. It finds them through
+// occupancyGrid, keeping the Snakes findSnake() returns, and places a cell's parts in id order and head to tail as placeParts() does,
+// so the same part ends up drawn on top
+template <typename FindSnake>
+void FrameSnapshot::placeDirtyCells(const World &world, PartLayer &layer, const std::vector<DirtyChunk> &chunks, uint64_t version,
+                                    std::vector<Occupant> &occupants, FindSnake findSnake) {
+    const PartStore &partStore = world.partStore;
+    const OccupancyGrid &occupancyGrid = world.occupancyGrid;
+    for (auto dirty = chunks.begin(); dirty != chunks.end(); ++dirty) {
+        std::vector<DrawnPart> &parts = layer.chunks[dirty->chunk];
+        parts.erase(std::remove_if(parts.begin(), parts.end(), [this, dirty](const DrawnPart &drawn) { return isDirty(*dirty, drawn.x, drawn.y); }),
+                    parts.end());
+        int originX = (dirty->chunk % chunkCols) << CHUNK_SHIFT;
+        int originY = (dirty->chunk / chunkCols) << CHUNK_SHIFT;
+        for (int y = originY; y < originY + CHUNK_SIZE; ++y) {
+            for (int x = originX; x < originX + CHUNK_SIZE; ++x) {
+                if (!isDirty(*dirty, x, y)) continue;
+                int index = occupancyGrid.cellIndex(x, y);
+                if (index < 0 || occupancyGrid.cells[index].count == 0) continue;
+                occupants.resize(occupancyGrid.cells[index].count);
+                int count = occupancyGrid.occupantsAt(x, y, occupants.data(), (int)occupants.size());
+                std::sort(occupants.begin(), occupants.begin() + count, [](const Occupant &a, const Occupant &b) { return a.snakeId < b.snakeId; });
+                for (int o = 0; o < count; ++o) {
+                    //a Snake with two parts in the cell is in it twice, both parts go in the first time
+                    if (o > 0 && occupants[o].snakeId == occupants[o - 1].snakeId) continue;
+                    const Snake *snake = findSnake(occupants[o].snakeId);
+                    if (snake == nullptr || snake->slot < 0) continue;
+                    for (int i = 0; i < snake->length; ++i) {
+                        int p = snake->part(i);
+                        if (partStore.cellX[p] == x && partStore.cellY[p] == y) parts.push_back(drawnPart(world, *snake, i, p));
+                    }
+                }
+            }
+        }
+        layer.versions[dirty->chunk] = version;
+    }
+}
+
+// markChunks() sets the bits of the on board cells in chunks, one DirtyChunk per chunk with any of them
+void FrameSnapshot::markChunks(std::vector<DirtyChunk> &chunks, const std::vector<CellRef> &cells) {
+    scratch.assign(chunkCols * chunkRows, -1);
+    for (auto it = cells.begin(); it != cells.end(); ++it) {
+        if (it->x < 0 || it->x >= boardCols || it->y < 0 || it->y >= boardRows) continue;
+        int chunk = chunkOf(it->x, it->y);
+        if (scratch[chunk] < 0) {
+            scratch[chunk] = (int)chunks.size();
+            DirtyChunk dirty = { chunk, { 0 } };
+            chunks.push_back(dirty);
+        }
+        int bit = (it->y & (CHUNK_SIZE - 1)) * CHUNK_SIZE + (it->x & (CHUNK_SIZE - 1));
+        chunks[scratch[chunk]].cells[bit >> 6] |= 1ull << (bit & 63);
+    }
+}
+
+bool FrameSnapshot::isDirty(const DirtyChunk &dirty, int x, int y) const {
+    int bit = (y & (CHUNK_SIZE - 1)) * CHUNK_SIZE + (x & (CHUNK_SIZE - 1));
+    return ((dirty.cells[bit >> 6] >> (bit & 63)) & 1) != 0;
+}
+
+/******************************************
+*          FrameExchange class            *
+*******************************************/
+
+FrameExchange::FrameExchange() {
+    backIndex = 0;
+    middle = 1;
+    frontIndex = 2;
+}
+
+// publish() makes back() the newest snapshot and takes over whichever buffer was the newest before, taken or not
+void FrameExchange::publish() {
+    backIndex = middle.exchange(backIndex | FRESH_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+}
+
+// acquire() makes the newest snapshot front() if one was published since the last acquire(), and returns whether it did
+bool FrameExchange::acquire() {
+    if ((middle.load(std::memory_order_acquire) & FRESH_BIT) == 0) return false;
+    frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & INDEX_MASK;
+    return true;
+}
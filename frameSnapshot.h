@@ -0,0 +1,111 @@
+#pragma once
+// frameSnapshot.h is what the simulation thread hands the render thread: every SnakePart on the board as its cell and atlas frame,
+// and which cells changed since the snapshot before. The render thread only reads published FrameSnapshots, so it never
+// looks at the simulation while a tick is running and the two threads overlap instead of taking turns
+#include "snakeSim.h"
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/******************************************
+*          FrameSnapshot class            *
+*                                         *
+*  an immutable copy of what the board    *
+*  looks like after one tick              *
+*******************************************/
+
+// one SnakePart to draw, frame is its spriteFrame() in the atlas
+struct DrawnPart {
+    int16_t  x;
+    int16_t  y;
+    uint16_t frame;
+};
+
+// the cells of one chunk that changed, bit (y % CHUNK_SIZE) * CHUNK_SIZE + x % CHUNK_SIZE of cells for cell x, y
+struct DirtyChunk {
+    int      chunk;
+    uint64_t cells[CHUNK_CELLS / 64];
+};
+
+// The board is cut into CHUNK_SIZE x CHUNK_SIZE chunks starting at cell 0, 0, and chunks[c] holds the parts of chunk c,
+// so the renderer can skip the empty chunks and the ones outside the window. versions[c] is the BoardParts build chunk c last changed in
+struct PartLayer {
+    std::vector<std::vector<DrawnPart>> chunks;
+    std::vector<uint64_t>               versions;
+};
+
+// BoardParts is the simulation thread's own copy of both PartLayers as of the last build(), made at tickNumber. Each build() only places
+// the parts in the dirty cells again and a snapshot only copies the chunks that changed since it was built last, so a build costs what
+// changed on the board rather than what is on it
+struct BoardParts {
+    BoardParts() : boardCols(0), boardRows(0), tickNumber(0), builds(0) {}
+
+    int                   boardCols;
+    int                   boardRows;
+    int                   tickNumber;
+    uint64_t              builds;
+    PartLayer             active;
+    PartLayer             frozen;
+    //the occupants of the cell being placed, it keeps its memory between builds
+    std::vector<Occupant> occupants;
+};
+
+// active holds the Snakes in snakeMasterVec and frozen the ones in frozenLayer. Frozen chunks only change when a Snake freezes, thaws
+// or dies there, so most builds copy none of them, and the renderer keeps the frozen layer drawn in a texture of its own.
+// dirtyChunks only hold the changes since the snapshot numbered sequence - 1, a renderer that missed that one redraws everything.
+// frozenDirtyChunks are the cells of the frozen layer that changed, they are in dirtyChunks as well
+struct FrameSnapshot {
+    FrameSnapshot();
+    void build(World &world, uint64_t sequence, BoardParts &boardParts);
+    int  chunkOf(int x, int y) const { return (y >> CHUNK_SHIFT) * chunkCols + (x >> CHUNK_SHIFT); }
+    bool isDirty(const DirtyChunk &dirty, int x, int y) const;
+
+    uint64_t                         sequence;
+    int                              tickNumber;
+    int                              boardCols;
+    int                              boardRows;
+    int                              chunkCols;
+    int                              chunkRows;
+    PartLayer                        active;
+    PartLayer                        frozen;
+    std::vector<DirtyChunk>          dirtyChunks;
+    std::vector<DirtyChunk>          frozenDirtyChunks;
+    //build() uses it to find a chunk's DirtyChunk, it keeps its memory between builds
+    std::vector<int>                 scratch;
+
+private:
+    template <typename SnakeIt>
+    void placeParts(const World &world, PartLayer &layer, SnakeIt first, SnakeIt last, uint64_t version);
+    template <typename FindSnake>
+    void placeDirtyCells(const World &world, PartLayer &layer, const std::vector<DirtyChunk> &chunks, uint64_t version,
+                         std::vector<Occupant> &occupants, FindSnake findSnake);
+    void markChunks(std::vector<DirtyChunk> &chunks, const std::vector<CellRef> &cells);
+};
+
+/******************************************
+*          FrameExchange class            *
+*                                         *
+*  a lock free triple buffer of           *
+*  FrameSnapshots between two threads     *
+*******************************************/
+
+// The simulation thread builds into back(), the render thread draws front(), and the third buffer is the newest published one.
+// publish() and acquire() each swap their buffer with the third in one atomic exchange, so neither thread ever waits on the other
+// and the render thread always gets the newest snapshot. FRESH_BIT is set in middle until the render thread takes it
+struct FrameExchange {
+    FrameExchange();
+    FrameSnapshot &       back()        { return buffers[backIndex]; }
+    const FrameSnapshot & front() const { return buffers[frontIndex]; }
+    void publish();
+    bool acquire();
+
+    static int const INDEX_MASK = 3;
+    static int const FRESH_BIT  = 4;
+
+    FrameSnapshot    buffers[3];
+    std::atomic<int> middle;
+    //only the simulation thread touches backIndex and boardParts, and only the render thread frontIndex
+    int              backIndex;
+    int              frontIndex;
+    BoardParts       boardParts;
+};
@@ -0,0 +1,73 @@
+// packSprites.cpp decodes the snake sprite pngs once, offline, scales them to one frame size, bakes every orientation of them
+// and writes them as a single pre-decoded atlas the game can map instead of loading pngs.
+//
+//   packSprites [output] [frameSize]      defaults to sprites.bundle and 25 pixel frames
+#include "SDL.h"
+#include "SDL_image.h"
+#include "spriteBundle.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+
+int main(int argc, char* argv[]) {
+    std::string output = argc > 1 ? argv[1] : "sprites.bundle";
+    int frameSize = argc > 2 ? std::atoi(argv[2]) : 25;
+    if (frameSize <= 0) {
+        std::cout << "frameSize has to be at least 1" << std::endl;
+        return 1;
+    }
+
+    int width = frameSize * FRAMES_PER_COLOR;
+    int height = frameSize * SNAKE_COLOR_COUNT;
+    SDL_Surface *sheet = SDL_CreateRGBSurface(0, width, height, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000);
+    if (sheet == nullptr) {
+        std::cout << "ERROR: atlas surface == null" << std::endl;
+        return 1;
+    }
+
+    for (int color = 0; color < SNAKE_COLOR_COUNT; ++color) {
+        for (int part = 0; part < SPRITE_PART_COUNT; ++part) {
+            SDL_Surface *sprite = IMG_Load(spriteBundleFiles[color][part]);
+            if (sprite == nullptr) {
+                std::cout << "ERROR: can't load " << spriteBundleFiles[color][part] << ": " << IMG_GetError() << std::endl;
+                return 1;
+            }
+            // copy the alpha channel as is instead of blending it onto the empty sheet
+            SDL_SetSurfaceBlendMode(sprite, SDL_BLENDMODE_NONE);
+            int frame = pngFrame(color, part);
+            SDL_Rect dst = { (frame % FRAMES_PER_COLOR) * frameSize, (frame / FRAMES_PER_COLOR) * frameSize, frameSize, frameSize };
+            SDL_BlitScaled(sprite, NULL, sheet, &dst);
+            SDL_FreeSurface(sprite);
+        }
+    }
+
+    SpriteBundleHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "SNKB", 4);
+    header.version = SPRITE_BUNDLE_VERSION;
+    header.frameSize = frameSize;
+    header.frameCols = FRAMES_PER_COLOR;
+    header.frameRows = SNAKE_COLOR_COUNT;
+    header.width = width;
+    header.height = height;
+    header.pitch = width * 4;
+    header.pixelsOffset = sizeof(SpriteBundleHeader);
+
+    std::ofstream out(output.c_str(), std::ios::binary | std::ios::trunc);
+    out.write((const char *)&header, sizeof(header));
+    SDL_LockSurface(sheet);
+    bakeOrientations((uint32_t *)sheet->pixels, sheet->pitch / 4, frameSize);
+    for (int y = 0; y < height; ++y) {
+        out.write((const char *)sheet->pixels + y * sheet->pitch, header.pitch);
+    }
+    SDL_UnlockSurface(sheet);
+    SDL_FreeSurface(sheet);
+    if (!out) {
+        std::cout << "ERROR: can't write " << output << std::endl;
+        return 1;
+    }
+    std::cout << "packed " << SNAKE_COLOR_COUNT * SPRITE_PART_COUNT << " sprites into " << output << ", " << width << "x" << height << std::endl;
+    return 0;
+}
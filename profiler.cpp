@@ -0,0 +1,181 @@
+#include "profiler.h"
+#ifdef SNAKES_PROFILE
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <thread>
+
+Profiler profiler;
+
+char const *const phaseNames[PHASE_COUNT] = { "tick", "plan", "resolve", "kill", "spawn", "render", "present" };
+char const *const counterNames[COUNTER_COUNT] = { "probes", "moves", "kills", "spawns", "draw calls", "texture binds" };
+
+Profiler::Profiler() {
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        samplesMs[p].reserve(ROLLING_SAMPLES);
+        nextSample[p] = 0;
+    }
+    for (int c = 0; c < COUNTER_COUNT; ++c) {
+        counters[c] = 0;
+        lastValue[c] = 0;
+    }
+    origin = profileClock::now();
+    currentTick = 0;
+    traceFirstTick = -1;
+    traceLastTick = -1;
+}
+
+// tracing() is true while the tick being run is inside the traced range, call it with mutex held
+static bool tracing(const Profiler &p) {
+    return p.traceFirstTick >= 0 && p.currentTick >= p.traceFirstTick && p.currentTick <= p.traceLastTick;
+}
+
+// threadRing() returns the calling thread's SampleRing, making and listing it the first time
+SampleRing * Profiler::threadRing() {
+    static thread_local SampleRing *ring = nullptr;
+    if (ring == nullptr) {
+        std::unique_ptr<SampleRing> made(new SampleRing());
+        made->head = 0;
+        made->tail = 0;
+        made->thread = (unsigned)std::hash<std::thread::id>()(std::this_thread::get_id());
+        ring = made.get();
+        std::lock_guard<std::mutex> lock(mutex);
+        rings.push_back(std::move(made));
+    }
+    return ring;
+}
+
+// record() puts one duration of a phase on the calling thread's ring, the next merge adds it to the rolling window and the trace
+void Profiler::record(int phase, profileClock::time_point start, profileClock::time_point end) {
+    SampleRing *ring = threadRing();
+    unsigned head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) == SampleRing::CAPACITY) return;
+    PhaseSample &sample = ring->samples[head % SampleRing::CAPACITY];
+    sample.phase = phase;
+    sample.start = start;
+    sample.end = end;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+// mergeSamples() empties every thread's ring into the rolling windows, and into the trace while one is being taken, call it with mutex held
+void Profiler::mergeSamples() {
+    bool traced = tracing(*this);
+    for (auto it = rings.begin(); it != rings.end(); ++it) {
+        SampleRing &ring = **it;
+        unsigned head = ring.head.load(std::memory_order_acquire);
+        unsigned tail = ring.tail.load(std::memory_order_relaxed);
+        for (; tail != head; ++tail) {
+            const PhaseSample &sample = ring.samples[tail % SampleRing::CAPACITY];
+            int phase = sample.phase;
+            double ms = std::chrono::duration<double, std::milli>(sample.end - sample.start).count();
+            if ((int)samplesMs[phase].size() < ROLLING_SAMPLES) {
+                samplesMs[phase].push_back(ms);
+            } else {
+                samplesMs[phase][nextSample[phase]] = ms;
+            }
+            nextSample[phase] = (nextSample[phase] + 1) % ROLLING_SAMPLES;
+
+            if (traced) {
+                TraceEvent event;
+                event.phase = phase;
+                event.counter = -1;
+                event.value = 0;
+                event.startUs = std::chrono::duration<double, std::micro>(sample.start - origin).count();
+                event.durationUs = ms * 1000;
+                event.thread = ring.thread;
+                traceEvents.push_back(event);
+            }
+        }
+        ring.tail.store(head, std::memory_order_release);
+    }
+}
+
+void Profiler::beginTick(int tick) {
+    std::lock_guard<std::mutex> lock(mutex);
+    currentTick = tick;
+}
+
+// endTick() merges the samples recorded since the last merge, closes the per tick counters, and writes the trace out once the last traced tick is done
+void Profiler::endTick() {
+    std::lock_guard<std::mutex> lock(mutex);
+    mergeSamples();
+    double nowUs = std::chrono::duration<double, std::micro>(profileClock::now() - origin).count();
+    for (int c = COUNTER_PROBES; c <= COUNTER_SPAWNS; ++c) {
+        lastValue[c] = counters[c].exchange(0, std::memory_order_relaxed);
+        if (tracing(*this)) {
+            TraceEvent event;
+            event.phase = -1;
+            event.counter = c;
+            event.value = lastValue[c].load(std::memory_order_relaxed);
+            event.startUs = nowUs;
+            event.durationUs = 0;
+            event.thread = 0;
+            traceEvents.push_back(event);
+        }
+    }
+    if (traceFirstTick >= 0 && currentTick == traceLastTick) {
+        writeTrace();
+        traceFirstTick = -1;
+        traceEvents.clear();
+    }
+}
+
+// endFrame() merges the samples too, so the render phases keep their windows up to date while no ticks run
+void Profiler::endFrame() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        mergeSamples();
+    }
+    for (int c = COUNTER_DRAW_CALLS; c <= COUNTER_TEXTURE_BINDS; ++c) {
+        lastValue[c] = counters[c].exchange(0, std::memory_order_relaxed);
+    }
+}
+
+// percentileMs() returns the duration of a phase that fraction of its rolling window is at or below, 0.5 for the p50
+double Profiler::percentileMs(int phase, double fraction) {
+    std::vector<double> sorted;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sorted = samplesMs[phase];
+    }
+    if (sorted.empty()) return 0;
+    size_t rank = std::min(sorted.size() - 1, (size_t)(fraction * sorted.size()));
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    return sorted[rank];
+}
+
+// traceTicks() starts collecting a trace of ticks firstTick to lastTick, written to file when lastTick ends
+void Profiler::traceTicks(int firstTick, int lastTick, const std::string &file) {
+    std::lock_guard<std::mutex> lock(mutex);
+    traceFirstTick = firstTick;
+    traceLastTick = lastTick;
+    traceFile = file;
+    traceEvents.clear();
+}
+
+// writeTrace() writes traceEvents as complete ("X") events for the phases and counter ("C") events for the counters, call it with mutex held
+bool Profiler::writeTrace() {
+    std::ofstream out(traceFile.c_str());
+    if (!out) {
+        std::cout << "ERROR: can't write trace " << traceFile << std::endl;
+        return false;
+    }
+    out << std::fixed << std::setprecision(3);
+    out << "{\"traceEvents\": [" << std::endl;
+    for (size_t i = 0; i < traceEvents.size(); ++i) {
+        const TraceEvent &event = traceEvents[i];
+        if (event.phase >= 0) {
+            out << "  {\"name\": \"" << phaseNames[event.phase] << "\", \"cat\": \"phase\", \"ph\": \"X\", \"pid\": 1"
+                << ", \"tid\": " << event.thread << ", \"ts\": " << event.startUs << ", \"dur\": " << event.durationUs << "}";
+        } else {
+            out << "  {\"name\": \"" << counterNames[event.counter] << "\", \"cat\": \"counter\", \"ph\": \"C\", \"pid\": 1"
+                << ", \"tid\": 0, \"ts\": " << event.startUs << ", \"args\": {\"value\": " << event.value << "}}";
+        }
+        out << (i + 1 < traceEvents.size() ? "," : "") << std::endl;
+    }
+    out << "]}" << std::endl;
+    std::cout << "wrote " << traceEvents.size() << " trace events to " << traceFile << std::endl;
+    return true;
+}
+#endif
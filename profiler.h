@@ -0,0 +1,118 @@
+#pragma once
+// profiler.h times the phases of every tick and frame and counts what they did.
+// It only exists when SNAKES_PROFILE is defined (make PROFILE=1, or SNAKES_PROFILE added to the preprocessor definitions of p3.vcxproj),
+// otherwise PROFILE_SCOPE() and PROFILE_COUNT() compile to nothing and none of this is built
+#ifdef SNAKES_PROFILE
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+enum profilePhases { PHASE_TICK, PHASE_PLAN, PHASE_RESOLVE, PHASE_KILL, PHASE_SPAWN, PHASE_RENDER, PHASE_PRESENT, PHASE_COUNT };
+
+// the first four are counted per tick, the last two per frame
+enum profileCounters { COUNTER_PROBES, COUNTER_MOVES, COUNTER_KILLS, COUNTER_SPAWNS, COUNTER_DRAW_CALLS, COUNTER_TEXTURE_BINDS, COUNTER_COUNT };
+
+typedef std::chrono::steady_clock profileClock;
+
+/******************************************
+*            Profiler class               *
+*                                         *
+*  rolling phase timings, counters and    *
+*  an optional chrome trace              *
+*******************************************/
+
+// one timed scope, as record() got it
+struct PhaseSample {
+    int                      phase;
+    profileClock::time_point start;
+    profileClock::time_point end;
+};
+
+// Every thread that records gets a SampleRing of its own the first time it does. Only that thread moves head and only the merge
+// in endTick() or endFrame() moves tail, so recording takes no lock. A thread that records more than CAPACITY samples
+// between two merges loses the newest ones
+struct SampleRing {
+    static unsigned const CAPACITY = 1024;
+
+    PhaseSample           samples[CAPACITY];
+    std::atomic<unsigned> head;
+    std::atomic<unsigned> tail;
+    unsigned              thread;
+};
+
+// Every phase keeps its last ROLLING_SAMPLES durations for the p50/p99. Counters are bumped from any thread and
+// moved into lastValue when their tick or frame ends. Between traceFirstTick and traceLastTick every phase and counter
+// also goes into traceEvents, which are written out as Chrome trace_event JSON (chrome://tracing) once traceLastTick is done.
+// mutex guards the rolling windows, the trace and the list of rings, never the recording itself
+struct Profiler {
+    static int const ROLLING_SAMPLES = 256;
+
+    Profiler();
+    void   record(int phase, profileClock::time_point start, profileClock::time_point end);
+    void   count(int counter, long long amount) { counters[counter].fetch_add(amount, std::memory_order_relaxed); }
+    void   beginTick(int tick);
+    void   endTick();
+    void   endFrame();
+    double percentileMs(int phase, double fraction);
+    void   traceTicks(int firstTick, int lastTick, const std::string &file);
+    bool   writeTrace();
+    SampleRing * threadRing();
+    void   mergeSamples();
+
+    struct TraceEvent {
+        int       phase;
+        int       counter;
+        long long value;
+        double    startUs;
+        double    durationUs;
+        unsigned  thread;
+    };
+
+    std::mutex              mutex;
+    //the rings stay with the profiler when their thread ends, a thread lives as long as its World's WorkerPool or the game
+    std::vector<std::unique_ptr<SampleRing>> rings;
+    std::vector<double>     samplesMs[PHASE_COUNT];
+    int                     nextSample[PHASE_COUNT];
+    std::atomic<long long>  counters[COUNTER_COUNT];
+    //the tick counters are set on the simulation thread and the frame counters on the main thread, either one reads all of them
+    std::atomic<long long>  lastValue[COUNTER_COUNT];
+    profileClock::time_point origin;
+
+    int                     currentTick;
+    int                     traceFirstTick;
+    int                     traceLastTick;
+    std::string             traceFile;
+    std::vector<TraceEvent> traceEvents;
+};
+
+extern Profiler profiler;
+extern char const *const phaseNames[PHASE_COUNT];
+extern char const *const counterNames[COUNTER_COUNT];
+
+// ScopedTimer records the time from its construction to the end of its scope under one phase
+struct ScopedTimer {
+    ScopedTimer(int phase) : phase(phase), start(profileClock::now()) {}
+    ~ScopedTimer() { profiler.record(phase, start, profileClock::now()); }
+
+    int                      phase;
+    profileClock::time_point start;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(phase) ScopedTimer PROFILE_CONCAT(profileScope, __LINE__)(phase)
+#define PROFILE_COUNT(counter, amount) profiler.count(counter, amount)
+#define PROFILE_BEGIN_TICK(tick) profiler.beginTick(tick)
+#define PROFILE_END_TICK() profiler.endTick()
+#define PROFILE_END_FRAME() profiler.endFrame()
+#else
+#define PROFILE_SCOPE(phase)
+#define PROFILE_COUNT(counter, amount)
+#define PROFILE_BEGIN_TICK(tick)
+#define PROFILE_END_TICK()
+#define PROFILE_END_FRAME()
+#endif
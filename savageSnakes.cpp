@@ -1,5 +1,13 @@
 #include "SDL.h"
+#ifndef SNAKES_NO_SDL_IMAGE
 #include "SDL_image.h"
+#endif
+#include "snakeSim.h"
+#include "profiler.h"
+#include "snapshot.h"
+#include "spriteBundle.h"
+#include "frameSnapshot.h"
+#include "frameCapture.h"
 #include <iostream>
 #include <vector>
 #include <iterator>
@@ -7,98 +15,374 @@
 #include <random>
 #include <chrono>
 #include <list>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 bool running = 1;
-enum directions { NORTH, EAST, SOUTH, WEST, TOP_RIGHT_CORNER, TOP_LEFT_CORNER, BOTTEM_RIGHT_CORNER, BOTTEM_LEFT_CORNER };
-enum gameStates { ASDF, GAME_TICK, DRAW };
-enum snakeColors { GREEN, BLUE, RED };
-
-//These strings are the file names for the different possible snakeParts textures
-std::string greenHeadString   = "greenHead.png";
-std::string greenBodyString   = "greenBody.png";
-std::string greenTailString   = "greenTail.png";
-std::string greenCornerString = "greenBodyCorner.png";
-
-std::string blueHeadString   = "blueHead.png";
-std::string blueBodyString   = "blueBody.png";
-std::string blueTailString   = "blueTail.png";
-std::string blueCornerString = "blueBodyCorner.png";
-
-std::string redHeadString   = "redHead.png";
-std::string redBodyString   = "redBody.png";
-std::string redTailString   = "redTail.png";
-std::string redCornerString = "redBodyCorner.png";
 
 //global vars for the window, renderer, and event
 SDL_Window   *window;
 SDL_Renderer *renderer;
 SDL_Event e;
 
-int snakeID = 0;
+//the game plays one World. The simulation thread ticks it, the main thread only reads its board size, which is set before that thread starts
+World world;
+
+//the board is drawn into boardTexture and kept between frames, each frame only redraws the cells its FrameSnapshot marks dirty and copies it to the window.
+//redrawWholeBoard is set when the texture's contents can't be trusted, at startup or when the renderer lost its targets.
+//frozenTexture holds just the frozen Snakes on the empty board, a dirty cell starts out as a copy of it and the moving Snakes are drawn on top
+SDL_Texture *boardTexture;
+SDL_Texture *frozenTexture;
+bool         redrawWholeBoard = true;
+//the sequence of the FrameSnapshot boardTexture shows
+uint64_t     drawnSequence = 0;
+
 int windowHeight = 800;
 int windowWidth = 500;
 int SNAKEPART_SIZE = 25;
 
-//These are the number ranges that use the rng, used for the spawning x position of the snake, the length of the snake, and the color of the snake
-std::uniform_real_distribution <double> startingXRange(0, windowWidth / SNAKEPART_SIZE);
-std::uniform_real_distribution <double> lengthRange(3, 10);
-std::uniform_real_distribution <double> colorRange(0, 3);
-std::default_random_engine rng(std::chrono::system_clock::now().time_since_epoch().count());
+//how far W A S D scroll, as a fraction of the window
+int const PAN_DIVISOR = 4;
+int const MIN_CELL_PIXELS = 2;
+int const MAX_CELL_PIXELS = 64;
+
+//the game ticks every TICKDELAY ms. If the loop falls behind it runs at most maxCatchUpTicks ticks before drawing again,
+//anything further behind than that is dropped instead of piling up
+int const TICKDELAY = 100;
+int maxCatchUpTicks = 5;
+
+//every input the player makes goes into inputLog when the game runs with --record, F5 saves a snapshot named after recordName and the tick
+std::string recordName = "savageSnakes";
+InputLog    inputLog;
+
+#ifdef SNAKES_PROFILE
+//F3 shows the p50 and p99 of every phase as bars on top of the board, a full bar is one TICKDELAY
+bool showProfileOverlay = false;
+SDL_Texture *lastDrawnTexture = nullptr;
+
+// countDraw() counts one draw call, and a texture bind when it draws from another texture than the last one did
+void countDraw(SDL_Texture *tex) {
+    PROFILE_COUNT(COUNTER_DRAW_CALLS, 1);
+    if (tex != lastDrawnTexture) {
+        PROFILE_COUNT(COUNTER_TEXTURE_BINDS, 1);
+        lastDrawnTexture = tex;
+    }
+}
+#define PROFILE_DRAW(tex) countDraw(tex)
+#else
+#define PROFILE_DRAW(tex)
+#endif
+
+//the sprites packed by packSprites, used instead of the pngs when it is there
+std::string const SPRITE_BUNDLE_FILE = "sprites.bundle";
+
+#ifndef SNAKES_NO_SDL_IMAGE
+// loadSurface() takes the filename and loads the image to a surface
+SDL_Surface *loadSurface(const std::string &file) {
+    SDL_Surface *surface = IMG_Load(file.c_str());
+    if(surface == nullptr) std::cout << "ERROR: surface == null" << std::endl;
+    return surface;
+}
+#endif
 
-// loadTexture() takes the filename and renderer and loads the image to a texture
-SDL_Texture *loadTexture(const std::string &file, SDL_Renderer *ren) {
-    SDL_Texture *texture = IMG_LoadTexture(renderer, file.c_str());
-    if(texture == nullptr) std::cout << "ERROR: texture == null" << std::endl;
-    return texture;
+/******************************************
+*           SpriteAtlas class             *
+*                                         *
+*  every snake sprite in a single texture *
+*******************************************/
+
+// spriteParts, spriteFrame() and the rest of the layout of the atlas live in spriteBundle.h
+struct SpriteAtlas {
+    SpriteAtlas();
+    bool load(SDL_Renderer *ren, int size);
+    bool loadBundle(SDL_Renderer *ren, const MappedFile &bundle);
+    void destroy();
+    SDL_Rect frameRect(int index);
+
+    SDL_Texture * texture;
+    int           frameSize;
+};
+
+SpriteAtlas spriteAtlas;
+
+SpriteAtlas::SpriteAtlas() {
+    texture = nullptr;
+    frameSize = 0;
 }
 
-// init() initializes SDL and creates an SDL_Window and SDL_Renderer
+#ifndef SNAKES_NO_SDL_IMAGE
+// load() decodes every color's head/body/tail/corner png of spriteBundleFiles once, scales them to size x size, bakes all of their orientations and packs them into one texture
+bool SpriteAtlas::load(SDL_Renderer *ren, int size) {
+    SDL_Surface *sheet = SDL_CreateRGBSurface(0, size * FRAMES_PER_COLOR, size * SNAKE_COLOR_COUNT, 32,
+                                              0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000);
+    if (sheet == nullptr) {
+        std::cout << "ERROR: atlas surface == null" << std::endl;
+        return false;
+    }
+    frameSize = size;
+
+    for (int color = 0; color < SNAKE_COLOR_COUNT; ++color) {
+        for (int part = 0; part < SPRITE_PART_COUNT; ++part) {
+            SDL_Surface *sprite = loadSurface(spriteBundleFiles[color][part]);
+            if (sprite == nullptr) continue;
+            // copy the alpha channel as is instead of blending it onto the empty sheet
+            SDL_SetSurfaceBlendMode(sprite, SDL_BLENDMODE_NONE);
+            SDL_Rect dst = frameRect(pngFrame(color, part));
+            SDL_BlitScaled(sprite, NULL, sheet, &dst);
+            SDL_FreeSurface(sprite);
+        }
+    }
+
+    SDL_LockSurface(sheet);
+    bakeOrientations((uint32_t *)sheet->pixels, sheet->pitch / 4, size);
+    SDL_UnlockSurface(sheet);
+
+    texture = SDL_CreateTextureFromSurface(ren, sheet);
+    SDL_FreeSurface(sheet);
+    if (texture == nullptr) {
+        std::cout << "ERROR: atlas texture == null" << std::endl;
+        return false;
+    }
+    return true;
+}
+#endif
+
+// loadBundle() uploads the already decoded atlas of a mapped sprites.bundle, checked by mapSpriteBundle(), straight into a texture
+bool SpriteAtlas::loadBundle(SDL_Renderer *ren, const MappedFile &bundle) {
+    const SpriteBundleHeader *header = (const SpriteBundleHeader *)bundle.data;
+    texture = SDL_CreateTexture(ren, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, header->width, header->height);
+    if (texture == nullptr) {
+        std::cout << "ERROR: atlas texture == null" << std::endl;
+        return false;
+    }
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    SDL_UpdateTexture(texture, NULL, bundle.data + header->pixelsOffset, header->pitch);
+    frameSize = header->frameSize;
+    return true;
+}
+
+// the sprite bundle is mapped on its own thread while init() creates the window, spriteBundleReady says whether it is usable
+MappedFile spriteBundle;
+bool       spriteBundleReady = false;
+
+// mapSpriteBundle() maps sprites.bundle, checks its header against the file size and reads every page once,
+// so the upload in init() copies from memory instead of waiting on the disk
+void mapSpriteBundle() {
+    if (!spriteBundle.open(SPRITE_BUNDLE_FILE) || spriteBundle.size < sizeof(SpriteBundleHeader)) return;
+    const SpriteBundleHeader *header = (const SpriteBundleHeader *)spriteBundle.data;
+    if (std::memcmp(header->magic, "SNKB", 4) != 0 || header->version != SPRITE_BUNDLE_VERSION ||
+        header->frameCols != FRAMES_PER_COLOR || header->frameRows != SNAKE_COLOR_COUNT ||
+        header->width != header->frameSize * FRAMES_PER_COLOR || header->height != header->frameSize * SNAKE_COLOR_COUNT ||
+        header->pitch < header->width * 4 || header->pixelsOffset + (uint64_t)header->pitch * header->height > spriteBundle.size) {
+        std::cout << "ERROR: " << SPRITE_BUNDLE_FILE << " is not a version " << SPRITE_BUNDLE_VERSION << " sprite bundle" << std::endl;
+        return;
+    }
+    volatile unsigned char touched = 0;
+    for (size_t offset = 0; offset < spriteBundle.size; offset += 4096) {
+        touched ^= spriteBundle.data[offset];
+    }
+    spriteBundleReady = true;
+}
+
+void SpriteAtlas::destroy() {
+    SDL_DestroyTexture(texture);
+    texture = nullptr;
+}
+
+// frameRect() returns where the sprite with the given atlas index sits inside the atlas texture
+SDL_Rect SpriteAtlas::frameRect(int index) {
+    SDL_Rect rect;
+    rect.x = (index % FRAMES_PER_COLOR) * frameSize;
+    rect.y = (index / FRAMES_PER_COLOR) * frameSize;
+    rect.w = frameSize;
+    rect.h = frameSize;
+    return rect;
+}
+
+// initRenderTargets() uploads the sprite atlas to renderer, from the bundle or else the pngs, and creates boardTexture and frozenTexture
+void initRenderTargets() {
+    if (!spriteBundleReady || !spriteAtlas.loadBundle(renderer, spriteBundle)) {
+#ifdef SNAKES_NO_SDL_IMAGE
+        std::cout << "ERROR: no usable " << SPRITE_BUNDLE_FILE << " and no SDL_image to load the pngs, run packSprites" << std::endl;
+#else
+        spriteAtlas.load(renderer, SNAKEPART_SIZE);
+#endif
+    }
+    spriteBundle.close();
+
+    boardTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, windowWidth, windowHeight);
+    SDL_SetTextureBlendMode(boardTexture, SDL_BLENDMODE_NONE);
+    frozenTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, windowWidth, windowHeight);
+    SDL_SetTextureBlendMode(frozenTexture, SDL_BLENDMODE_NONE);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    world.trackDirtyCells = true;
+}
+
+// init() initializes SDL and creates an SDL_Window and SDL_Renderer. The sprite bundle gets mapped on another thread meanwhile,
+// only the upload itself has to wait for the renderer, which SDL only lets the thread that made it use. Without a bundle it falls back to the pngs
 void init() {
+    std::thread bundleLoader(mapSpriteBundle);
+
     SDL_Init(SDL_INIT_EVERYTHING);
 
     window   = SDL_CreateWindow("Snakes", 10, 30, windowWidth, windowHeight, SDL_WINDOW_SHOWN);
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_TARGETTEXTURE);
+
+    bundleLoader.join();
+    initRenderTargets();
+}
+
+
+/******************************************
+*             Camera class                *
+*                                         *
+*  which part of the board the window     *
+*  shows, and how big a cell is drawn     *
+*******************************************/
+
+// scrollX, scrollY is the board pixel at the top left corner of the window, with every cell cellPixels wide.
+// The board can be any size, the camera keeps the window inside it
+struct Camera {
+    Camera();
+    void pan(int dx, int dy);
+    void zoom(int steps);
+    void clamp();
+    CellRect visibleCells() const;
+    SDL_Rect cellRect(int x, int y) const;
+
+    int scrollX;
+    int scrollY;
+    int cellPixels;
+};
+
+Camera camera;
+
+Camera::Camera() {
+    scrollX = 0;
+    scrollY = 0;
+    cellPixels = SNAKEPART_SIZE;
 }
 
+void Camera::pan(int dx, int dy) {
+    scrollX += dx;
+    scrollY += dy;
+    clamp();
+}
 
-// tickCallBack() creates a userevent and pushes it to the queue at the given interval. I use that userevent as the gametick to move the snakes
-Uint32 tickCallBack(Uint32 interval, void* param) {
-    SDL_Event e;
-    SDL_UserEvent userevent;
-    userevent.type = SDL_USEREVENT;
-    userevent.code = GAME_TICK;
-    userevent.data1 = NULL;
-    userevent.data2 = NULL;
+// zoom() grows or shrinks the cells by a quarter per step, keeping the cell in the middle of the window where it is
+void Camera::zoom(int steps) {
+    double centerX = (scrollX + windowWidth / 2) / (double)cellPixels;
+    double centerY = (scrollY + windowHeight / 2) / (double)cellPixels;
+    for (; steps > 0; --steps) cellPixels += std::max(1, cellPixels / 4);
+    for (; steps < 0; ++steps) cellPixels -= std::max(1, cellPixels / 5);
+    cellPixels = std::max(MIN_CELL_PIXELS, std::min(MAX_CELL_PIXELS, cellPixels));
+    scrollX = (int)(centerX * cellPixels) - windowWidth / 2;
+    scrollY = (int)(centerY * cellPixels) - windowHeight / 2;
+    clamp();
+}
 
-    e.type = SDL_USEREVENT;
-    e.user = userevent;
+void Camera::clamp() {
+    scrollX = std::max(0, std::min(scrollX, world.boardCols * cellPixels - windowWidth));
+    scrollY = std::max(0, std::min(scrollY, world.boardRows * cellPixels - windowHeight));
+}
 
-    SDL_PushEvent(&e);
-    return interval;
+// visibleCells() returns the cells of the board that are at least partly in the window
+CellRect Camera::visibleCells() const {
+    CellRect view;
+    view.x = scrollX / cellPixels;
+    view.y = scrollY / cellPixels;
+    view.w = std::min(world.boardCols, (scrollX + windowWidth + cellPixels - 1) / cellPixels) - view.x;
+    view.h = std::min(world.boardRows, (scrollY + windowHeight + cellPixels - 1) / cellPixels) - view.y;
+    return view;
+}
+
+// cellRect() returns where board cell x, y lands in the window
+SDL_Rect Camera::cellRect(int x, int y) const {
+    SDL_Rect rect;
+    rect.x = x * cellPixels - scrollX;
+    rect.y = y * cellPixels - scrollY;
+    rect.w = cellPixels;
+    rect.h = cellPixels;
+    return rect;
+}
+
+/******************************************
+*           TickStats class               *
+*                                         *
+*  how late the game ticks run            *
+*******************************************/
+
+// lateness is how long after its scheduled time a tick actually ran. The simulation thread records, the main thread reads
+// the summary for the window title, mutex keeps them apart
+struct TickStats {
+    TickStats();
+    void record(double lateMs, bool catchUp);
+    void drop(long long behind);
+    std::string summary();
+    void print();
+
+    std::mutex mutex;
+    long long ticks;
+    long long catchUpTicks;
+    long long droppedTicks;
+    double    totalLateMs;
+    double    worstLateMs;
+};
+
+TickStats tickStats;
+
+TickStats::TickStats() {
+    ticks = 0;
+    catchUpTicks = 0;
+    droppedTicks = 0;
+    totalLateMs = 0;
+    worstLateMs = 0;
+}
+
+void TickStats::record(double lateMs, bool catchUp) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++ticks;
+    if (catchUp) ++catchUpTicks;
+    totalLateMs += lateMs;
+    worstLateMs = std::max(worstLateMs, lateMs);
+}
+
+void TickStats::drop(long long behind) {
+    std::lock_guard<std::mutex> lock(mutex);
+    droppedTicks += behind;
+}
+
+std::string TickStats::summary() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return "tick lateness avg " + std::to_string(ticks > 0 ? totalLateMs / ticks : 0) + " ms, worst " + std::to_string(worstLateMs) +
+           " ms, dropped " + std::to_string(droppedTicks);
+}
+
+void TickStats::print() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::cout << "ticks: " << ticks
+              << ", average lateness: " << (ticks > 0 ? totalLateMs / ticks : 0) << " ms"
+              << ", worst lateness: " << worstLateMs << " ms"
+              << ", catch-up ticks: " << catchUpTicks
+              << ", dropped ticks: " << droppedTicks << std::endl;
 }
 
 /******************************************
 *           SnakePart class               *
 *                                         *
+*  render data only, built from a         *
+*  DrawnPart of a FrameSnapshot           *
 *******************************************/
 struct SnakePart {
     SnakePart();
     void render();
 
-    SDL_Texture * headTexture;
-    SDL_Texture * bodyTexture;
-    SDL_Texture * tailTexture;
-    SDL_Texture * cornerTexture;
-    
-    int         slot;
-    int         direction;
-    int         corner;
-    int         color;
-    bool        isHead;
-    bool        isBody;
-    bool        isTail;
+    int         atlasIndex;
     SDL_Rect    sRect;
-    std::string file;
 };
 
 SnakePart::SnakePart() {
@@ -107,427 +391,618 @@ SnakePart::SnakePart() {
     sRect.x = 0;
     sRect.y = 0;
 
-    headTexture = nullptr;
-    bodyTexture = nullptr;
-    tailTexture = nullptr;
-    cornerTexture = nullptr;
-
-    direction = SOUTH;
-    isHead = false;
-    isBody = false;
-    isTail = false;
+    atlasIndex = 0;
 }
 
-// figures out which SnakePart::texture to render based on SnakePart::corner and SnakePart::direction
+// draws the atlas frame the simulation picked for the part, every orientation is baked into the atlas so nothing is rotated here
 void SnakePart::render() {
-    SDL_Texture * tex = nullptr;
+    SDL_Texture * tex = spriteAtlas.texture;
+    SDL_Rect frame = spriteAtlas.frameRect(atlasIndex);
+    PROFILE_DRAW(tex);
+    SDL_RenderCopy(renderer, tex, &frame, &sRect);
+}
 
-    if (isHead == true) {
-        tex = headTexture;
-    } else if (isBody) {
-        tex = bodyTexture;
-    } else {
-        tex = tailTexture;
-    }
-    if (corner == BOTTEM_LEFT_CORNER) {
-         SDL_RenderCopy(renderer, cornerTexture, NULL, &sRect);
-    } else if (corner == BOTTEM_RIGHT_CORNER) {
-        SDL_RenderCopyEx(renderer, cornerTexture, NULL, &sRect, 270, NULL, SDL_FLIP_NONE);
-    } else if (corner == TOP_LEFT_CORNER) {
-        SDL_RenderCopyEx(renderer, cornerTexture, NULL, &sRect, 90, NULL, SDL_FLIP_NONE);
-    } else if (corner == TOP_RIGHT_CORNER) {
-        SDL_RenderCopyEx(renderer, cornerTexture, NULL, &sRect, 180, NULL, SDL_FLIP_NONE);
-    } else {
-        if (direction == NORTH) {
-            SDL_RenderCopyEx(renderer, tex, NULL, &sRect, 90, NULL, SDL_FLIP_NONE);
-        } else if (direction == EAST) {
-            SDL_RenderCopyEx(renderer, tex, NULL, &sRect, 0, NULL, SDL_FLIP_HORIZONTAL);
-        } else if (direction == SOUTH) {
-            SDL_RenderCopyEx(renderer, tex, NULL, &sRect, 270, NULL, SDL_FLIP_NONE);
-        } else if (direction == WEST) {
-            SDL_RenderCopy(renderer, tex, NULL, &sRect);
+// renderDrawnPart() builds the SnakePart render data for one part of a FrameSnapshot and calls its render function
+void renderDrawnPart(const DrawnPart &drawn) {
+    SnakePart sp;
+    sp.atlasIndex = drawn.frame;
+    sp.sRect = camera.cellRect(drawn.x, drawn.y);
+    sp.render();
+}
+
+// inView() is true when cell x, y is inside view
+bool inView(const CellRect &view, int x, int y) {
+    return x >= view.x && x < view.x + view.w && y >= view.y && y < view.y + view.h;
+}
+
+// renderVisibleChunks() draws the parts of layer in the window, visiting only the chunks of the snapshot that overlap it and skipping the empty ones,
+// so how long it takes depends on the size of the window and not on the size of the board
+void renderVisibleChunks(const FrameSnapshot &frame, const PartLayer &layer) {
+    CellRect view = camera.visibleCells();
+    if (view.w <= 0 || view.h <= 0) return;
+    for (int chunkY = view.y >> CHUNK_SHIFT; chunkY <= (view.y + view.h - 1) >> CHUNK_SHIFT; ++chunkY) {
+        for (int chunkX = view.x >> CHUNK_SHIFT; chunkX <= (view.x + view.w - 1) >> CHUNK_SHIFT; ++chunkX) {
+            int chunk = chunkY * frame.chunkCols + chunkX;
+            for (auto it = layer.chunks[chunk].begin(); it != layer.chunks[chunk].end(); ++it) {
+                if (inView(view, it->x, it->y)) renderDrawnPart(*it);
+            }
         }
     }
-} 
-
-/******************************************
-*               Snake class               *
-*                                         *
-*  an object with a vector of SnakeParts  *
-*******************************************/
+}
 
-struct Snake {
-    int                    id;
-    int                    length;
-    int                    direction;
-    int                    color;
-    bool                   wantsSouth;
-    bool                   dieNextTick;
-    SDL_Point              vel;
-    std::vector<SnakePart> snakeVecMember;
-
-    Snake() {
-        id = snakeID;
-        direction = SOUTH;
-        length = lengthRange(rng);
-        dieNextTick = false;
-        vel.x = 0;
-        vel.y = SNAKEPART_SIZE;
-        color = colorRange(rng);
-        createSnakeParts(length, color);
-        texSnakeParts();
-        arrangeSnakeParts();
-        ++snakeID;
-    }
-
-    ~Snake(){
-        if(dieNextTick){
-            for (int i = 0; i < snakeVecMember.size(); ++i) {
-                SDL_DestroyTexture(snakeVecMember.at(i).headTexture);
-                SDL_DestroyTexture(snakeVecMember.at(i).bodyTexture);
-                SDL_DestroyTexture(snakeVecMember.at(i).tailTexture);
-                SDL_DestroyTexture(snakeVecMember.at(i).cornerTexture);
+// renderDirtyChunk() clears the dirty cells of one chunk that are in the window, or copies them from background if there is one,
+// and draws the parts of layer that sit in them now
+void renderDirtyChunk(const FrameSnapshot &frame, const PartLayer &layer, const DirtyChunk &dirty, const CellRect &view, SDL_Texture *background) {
+    int originX = (dirty.chunk % frame.chunkCols) << CHUNK_SHIFT;
+    int originY = (dirty.chunk / frame.chunkCols) << CHUNK_SHIFT;
+    for (int y = originY; y < originY + CHUNK_SIZE; ++y) {
+        for (int x = originX; x < originX + CHUNK_SIZE; ++x) {
+            if (!frame.isDirty(dirty, x, y) || !inView(view, x, y)) continue;
+            SDL_Rect cellRect = camera.cellRect(x, y);
+            if (background != nullptr) {
+                SDL_RenderCopy(renderer, background, &cellRect, &cellRect);
+            } else {
+                SDL_RenderFillRect(renderer, &cellRect);
             }
+            PROFILE_DRAW(background);
         }
     }
+    for (auto it = layer.chunks[dirty.chunk].begin(); it != layer.chunks[dirty.chunk].end(); ++it) {
+        if (frame.isDirty(dirty, it->x, it->y) && inView(view, it->x, it->y)) renderDrawnPart(*it);
+    }
+}
 
-    void createSnakeParts(int length, int color);
-    void render();
-    void arrangeSnakeParts();
-    void texSnakeParts();
-    void orient();
-    void move();
-    bool collisionSnakeCheck();
-};
+// cameraMoved() redraws the whole window next frame
+void cameraMoved() {
+    redrawWholeBoard = true;
+}
 
-// createSnakeParts constructs a SnakePart and sets the color, colorStrings, and sets the isHead, isBody, isTail booleans. Pushes the created SnakePart to the snakeVecMember vector;
-void Snake::createSnakeParts(int length, int color) {
-    SnakePart sp;
-    sp.color = color;
-    std::string colorHeadString;
-    std::string colorBodyString;
-    std::string colorTailString;
-
-    if (color == GREEN) {
-        colorHeadString = "greenHead.png";
-        colorBodyString = "greenBody.png";
-        colorTailString = "greenTail.png";
-    } else if (color == BLUE) {
-        colorHeadString = "blueHead.png";
-        colorBodyString = "blueBody.png";
-        colorTailString = "blueTail.png";
-    } else if (color == RED) {
-        colorHeadString = "redHead.png";
-        colorBodyString = "redBody.png";
-        colorTailString = "redTail.png";
-    }
-
-    for (int i = 0; i < length; ++i) {
-        sp.slot = i;
-        if (i == 0) {
-            sp.file = colorHeadString;
-            sp.isHead = true;
-            sp.isBody = false;
-            sp.isTail = false;
-        } else if (i == length - 1) {
-            sp.file = colorTailString;
-            sp.isHead = false;
-            sp.isBody = false;
-            sp.isTail = true;
-        } else {
-            sp.file = colorBodyString;
-            sp.isHead = false;
-            sp.isBody = true;
-            sp.isTail = false;
-        }
-        snakeVecMember.push_back(sp);
-        
-    } 
+// displayFrameCounts() returns how many performance counter counts one frame of the window's display lasts, 60hz if the display doesn't say
+Uint64 displayFrameCounts() {
+    SDL_DisplayMode mode;
+    int refreshRate = 60;
+    if (SDL_GetWindowDisplayMode(window, &mode) == 0 && mode.refresh_rate > 0) {
+        refreshRate = mode.refresh_rate;
+    }
+    return SDL_GetPerformanceFrequency() / refreshRate;
 }
 
-// render() iterates through the snakeVecMember vector and calls the render function of each SnakePart
-void Snake::render() {
-    for (auto it = snakeVecMember.begin(); it != snakeVecMember.end(); ++it){
-        it->render();
+/******************************************
+*          simulation thread              *
+*                                         *
+*  runs every tick and publishes a        *
+*  FrameSnapshot after each one           *
+*******************************************/
+
+// Once the game starts only the simulation thread touches the simulation. The main thread pumps SDL events, queues the player's
+// commands in pendingCommands and draws the newest FrameSnapshot, so a slow SDL_RenderPresent never holds up a tick and a slow
+// tick never holds up input or drawing. A command is one of the inputActions or COMMAND_SAVE_SNAPSHOT
+int const COMMAND_SAVE_SNAPSHOT = INPUT_ACTION_COUNT;
+
+std::mutex              simMutex;
+std::condition_variable simWake;
+std::vector<int>        pendingCommands;
+bool                    simQuitting = false;
+FrameExchange           frameExchange;
+
+//pushed by the simulation thread after every publish to wake the main thread's SDL_WaitEventTimeout()
+Uint32 frameReadyEvent = SDL_USEREVENT;
+
+// playerInput() hands one of the inputActions, or COMMAND_SAVE_SNAPSHOT, to the simulation thread, which runs it before its next tick
+void playerInput(int command) {
+    {
+        std::lock_guard<std::mutex> lock(simMutex);
+        pendingCommands.push_back(command);
     }
+    simWake.notify_one();
 }
 
-// arrangeSnakeParts() iterates through the snakeVecMember vector and sets the initial sRect.x and sRect.y 
-void Snake::arrangeSnakeParts() {
-    int y = 0;
-    for (auto it = snakeVecMember.begin(); it != snakeVecMember.end(); ++it) {
-        it->sRect.x = SNAKEPART_SIZE * (int)startingXRange(rng);
-        it->sRect.y = y;
-        y -= SNAKEPART_SIZE;
+// runCommand() applies one queued command on the simulation thread and logs inputs with the tick they came after
+void runCommand(int command) {
+    if (command == COMMAND_SAVE_SNAPSHOT) {
+        std::string file = recordName + "-" + std::to_string(world.tickNumber) + ".snk";
+        if (saveSnapshot(world, file, inputLog.records)) std::cout << "saved " << file << std::endl;
+    } else {
+        world.applyInput(command);
+        inputLog.record(world.tickNumber, command);
     }
 }
 
-// textSnakeParts() sets the correct texture for the correct snake color
-void Snake::texSnakeParts() {
-    if (color == GREEN) {
-        for (auto it = snakeVecMember.begin(); it != snakeVecMember.end(); ++it) {
-            it->headTexture = loadTexture(greenHeadString, renderer);
-            it->bodyTexture = loadTexture(greenBodyString, renderer);
-            it->tailTexture = loadTexture(greenTailString, renderer);
-            it->cornerTexture = loadTexture(greenCornerString, renderer);
-        }
-    } else if (color == BLUE) {
-        for (auto it = snakeVecMember.begin(); it != snakeVecMember.end(); ++it) {
-            it->headTexture = loadTexture(blueHeadString, renderer);
-            it->bodyTexture = loadTexture(blueBodyString, renderer);
-            it->tailTexture = loadTexture(blueTailString, renderer);
-            it->cornerTexture = loadTexture(blueCornerString, renderer);
+// publishFrame() builds the next FrameSnapshot from the simulation, hands it to the main thread and wakes it
+void publishFrame(uint64_t sequence) {
+    frameExchange.back().build(world, sequence, frameExchange.boardParts);
+    frameExchange.publish();
+    SDL_Event ready;
+    SDL_zero(ready);
+    ready.type = frameReadyEvent;
+    SDL_PushEvent(&ready);
+}
+
+// simulationLoop() runs game ticks on a fixed timestep until simQuitting is set. It sleeps until the next tick is due or a command
+// comes in. If it falls behind it runs at most maxCatchUpTicks ticks before publishing again, anything further behind is dropped
+void simulationLoop() {
+    typedef std::chrono::steady_clock simClock;
+    std::chrono::milliseconds const tickLength(TICKDELAY);
+    simClock::time_point nextTick = simClock::now() + tickLength;
+    uint64_t sequence = 0;
+    publishFrame(++sequence);
+
+    std::vector<int> commands;
+    std::unique_lock<std::mutex> lock(simMutex);
+    while (!simQuitting) {
+        simWake.wait_until(lock, nextTick, [] { return simQuitting || !pendingCommands.empty(); });
+        commands.swap(pendingCommands);
+        lock.unlock();
+
+        bool changed = !commands.empty();
+        for (auto it = commands.begin(); it != commands.end(); ++it) {
+            runCommand(*it);
         }
-    } else if (color == RED) {
-        for (auto it = snakeVecMember.begin(); it != snakeVecMember.end(); ++it) {
-            it->headTexture = loadTexture(redHeadString, renderer);
-            it->bodyTexture = loadTexture(redBodyString, renderer);
-            it->tailTexture = loadTexture(redTailString, renderer);
-            it->cornerTexture = loadTexture(redCornerString, renderer);
+        commands.clear();
+
+        simClock::time_point now = simClock::now();
+        int ticksRun = 0;
+        while (now >= nextTick && ticksRun < maxCatchUpTicks) {
+            tickStats.record(std::chrono::duration<double, std::milli>(now - nextTick).count(), ticksRun > 0);
+            world.gameTick();
+            nextTick += tickLength;
+            ++ticksRun;
+            changed = true;
+            now = simClock::now();
         }
-    } else std::cout << "failed to texture snake" << std::endl;
-}
-
-// orient() sets SnakePart::direction, gets called at the end of the Snake::move() function;
-// the new direction is based on the current SnakeParts direction and the direction of the snakePart in front of it.
-// so if the snakepart2 is facing south and snakepart1 is facing west, the Snake::corner will be set to BOTTEM_LEFT_CORNER
-void Snake::orient() {
-    for (auto it = snakeVecMember.rbegin(); it != snakeVecMember.rend(); ++it) {
-        if (it == std::prev(snakeVecMember.rend())) {
-            it->direction = direction;
-        } else if (it == snakeVecMember.rbegin()) {
-            it->direction = std::next(it+1)->direction;
-        } else {
-            it->direction = std::next(it)->direction; 
+        // still behind after the catch-up budget, skip ahead instead of letting the backlog grow
+        if (now >= nextTick) {
+            long long behind = (now - nextTick) / tickLength + 1;
+            tickStats.drop(behind);
+            nextTick += behind * tickLength;
         }
+
+        if (changed) publishFrame(++sequence);
+        lock.lock();
     }
-    
-    for (auto snakeIt = snakeVecMember.begin(); snakeIt != (snakeVecMember.end()-1); ++snakeIt) {
-        if (snakeIt->direction == SOUTH && std::next(snakeIt)->direction == EAST) {
-            std::next(snakeIt)->corner = BOTTEM_LEFT_CORNER;
-        } else if (snakeIt->direction == SOUTH && std::next(snakeIt)->direction == WEST) {
-            std::next(snakeIt)->corner = BOTTEM_RIGHT_CORNER;
-        } else if (snakeIt->direction == NORTH && std::next(snakeIt)->direction == WEST) {
-            std::next(snakeIt)->corner = TOP_RIGHT_CORNER;
-        } else if (snakeIt->direction == NORTH && std::next(snakeIt)->direction == EAST) {
-            std::next(snakeIt)->corner = TOP_LEFT_CORNER;
-        } else if (snakeIt->direction == WEST && std::next(snakeIt)->direction == SOUTH) {
-            std::next(snakeIt)->corner = TOP_LEFT_CORNER;
-        } else if (snakeIt->direction == EAST && std::next(snakeIt)->direction == NORTH) {
-            std::next(snakeIt)->corner = BOTTEM_RIGHT_CORNER;
-        } else if (snakeIt->direction == EAST && std::next(snakeIt)->direction == SOUTH) {
-            std::next(snakeIt)->corner = TOP_RIGHT_CORNER;
-        } else if (snakeIt->direction == WEST && std::next(snakeIt)->direction == NORTH) {
-            std::next(snakeIt)->corner = BOTTEM_LEFT_CORNER;
-        } else {
-            std::next(snakeIt)->corner = NULL;
+}
+
+// handleEvent() handles one SDL_Event: quitting, the keys that remove, steer or add snakes, scrolling and zooming the camera,
+// and F5 to save a snapshot
+void handleEvent(SDL_Event &event) {
+    if (event.type == SDL_QUIT) {
+        running = 0;
+    } else if (event.type == SDL_RENDER_TARGETS_RESET) {
+        redrawWholeBoard = true;
+    } else if (event.type == SDL_MOUSEWHEEL) {
+        camera.zoom(event.wheel.y);
+        cameraMoved();
+    } else if (event.type == SDL_KEYDOWN) {
+        if (event.key.keysym.sym == SDLK_UP || event.key.keysym.sym == SDLK_DELETE) {
+            playerInput(INPUT_REMOVE_OLDEST);
+        } else if (event.key.keysym.sym == SDLK_LEFT) {
+            playerInput(INPUT_STEER_WEST);
+        } else if (event.key.keysym.sym == SDLK_DOWN) {
+            playerInput(INPUT_STEER_SOUTH);
+        } else if (event.key.keysym.sym == SDLK_RIGHT) {
+            playerInput(INPUT_STEER_EAST);
+        } else if (event.key.keysym.sym == SDLK_RETURN) {
+            playerInput(INPUT_SPAWN);
+        } else if (event.key.keysym.sym == SDLK_F5) {
+            playerInput(COMMAND_SAVE_SNAPSHOT);
+        } else if (event.key.keysym.sym == SDLK_w) {
+            camera.pan(0, -windowHeight / PAN_DIVISOR);
+            cameraMoved();
+        } else if (event.key.keysym.sym == SDLK_a) {
+            camera.pan(-windowWidth / PAN_DIVISOR, 0);
+            cameraMoved();
+        } else if (event.key.keysym.sym == SDLK_s) {
+            camera.pan(0, windowHeight / PAN_DIVISOR);
+            cameraMoved();
+        } else if (event.key.keysym.sym == SDLK_d) {
+            camera.pan(windowWidth / PAN_DIVISOR, 0);
+            cameraMoved();
+        } else if (event.key.keysym.sym == SDLK_EQUALS) {
+            camera.zoom(1);
+            cameraMoved();
+        } else if (event.key.keysym.sym == SDLK_MINUS) {
+            camera.zoom(-1);
+            cameraMoved();
         }
-        //If the iterator is pointing to the second to last SnakePart, then make the last SnakePart have no corner 
-        if (snakeIt == std::prev(snakeVecMember.end()-1)) {
-            std::next(snakeIt)->corner = NULL;
+#ifdef SNAKES_PROFILE
+        if (event.key.keysym.sym == SDLK_F3) {
+            showProfileOverlay = !showProfileOverlay;
         }
+#endif
     }
 }
 
-// iterates backward through the snakeVecMember and adds the snakePart::vel to the snakePart::sRect
-void Snake::move() {
-    for (auto it = snakeVecMember.rbegin(); it != snakeVecMember.rend(); ++it) {
-        if (it == std::prev(snakeVecMember.rend())) {
-            it->sRect.x += vel.x;
-            it->sRect.y += vel.y;
-        } else {
-            it->sRect.x = std::next(it)->sRect.x;
-            it->sRect.y = std::next(it)->sRect.y;
+#ifdef SNAKES_PROFILE
+// renderProfileOverlay() draws a row per phase in the top left corner: the p99 as a dim bar with the p50 as a bright bar over it
+void renderProfileOverlay() {
+    int const rowHeight = 6;
+    int const fullWidth = windowWidth / 2;
+    SDL_Rect background = { 0, 0, fullWidth + 4, PHASE_COUNT * (rowHeight + 2) + 2 };
+    SDL_SetRenderDrawColor(renderer, 32, 32, 32, 255);
+    SDL_RenderFillRect(renderer, &background);
+    for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+        double p50 = profiler.percentileMs(phase, 0.5);
+        double p99 = profiler.percentileMs(phase, 0.99);
+        SDL_Rect bar = { 2, 2 + phase * (rowHeight + 2), 0, rowHeight };
+        bar.w = std::min(fullWidth, (int)(p99 / TICKDELAY * fullWidth) + 1);
+        SDL_SetRenderDrawColor(renderer, 96, 48, 48, 255);
+        SDL_RenderFillRect(renderer, &bar);
+        bar.w = std::min(fullWidth, (int)(p50 / TICKDELAY * fullWidth) + 1);
+        SDL_SetRenderDrawColor(renderer, 240, 160, 64, 255);
+        SDL_RenderFillRect(renderer, &bar);
+    }
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+}
+
+// profileSummary() returns the p50/p99 of every phase and the counters of the last tick and frame, for the window title
+std::string profileSummary() {
+    std::string summary;
+    for (int phase = 0; phase < PHASE_COUNT; ++phase) {
+        summary += std::string(" ") + phaseNames[phase] + " " + std::to_string(profiler.percentileMs(phase, 0.5)) + "/" + std::to_string(profiler.percentileMs(phase, 0.99));
+    }
+    for (int counter = 0; counter < COUNTER_COUNT; ++counter) {
+        summary += std::string(", ") + counterNames[counter] + " " + std::to_string(profiler.lastValue[counter].load(std::memory_order_relaxed));
+    }
+    return summary;
+}
+#endif
+
+// renderBoard() brings frozenTexture and boardTexture up to date with frame, redrawing only their dirty chunks when the textures show
+// the snapshot just before it and the whole window otherwise, then copies the board to the window and presents the frame
+void renderBoard(const FrameSnapshot &frame) {
+    {
+        PROFILE_SCOPE(PHASE_RENDER);
+        if (frame.sequence != drawnSequence && frame.sequence != drawnSequence + 1) {
+            redrawWholeBoard = true;
+        }
+        if (redrawWholeBoard) {
+            SDL_SetRenderTarget(renderer, frozenTexture);
+            SDL_RenderClear(renderer);
+            renderVisibleChunks(frame, frame.frozen);
+            SDL_SetRenderTarget(renderer, boardTexture);
+            SDL_RenderCopy(renderer, frozenTexture, NULL, NULL);
+            PROFILE_DRAW(frozenTexture);
+            renderVisibleChunks(frame, frame.active);
+            redrawWholeBoard = false;
+        } else if (frame.sequence == drawnSequence + 1) {
+            CellRect view = camera.visibleCells();
+            if (!frame.frozenDirtyChunks.empty()) {
+                SDL_SetRenderTarget(renderer, frozenTexture);
+                for (auto it = frame.frozenDirtyChunks.begin(); it != frame.frozenDirtyChunks.end(); ++it) {
+                    renderDirtyChunk(frame, frame.frozen, *it, view, nullptr);
+                }
+            }
+            SDL_SetRenderTarget(renderer, boardTexture);
+            for (auto it = frame.dirtyChunks.begin(); it != frame.dirtyChunks.end(); ++it) {
+                renderDirtyChunk(frame, frame.active, *it, view, frozenTexture);
+            }
         }
+        drawnSequence = frame.sequence;
+        SDL_SetRenderTarget(renderer, NULL);
+    }
+    {
+        PROFILE_SCOPE(PHASE_PRESENT);
+        SDL_RenderCopy(renderer, boardTexture, NULL, NULL);
+        PROFILE_DRAW(boardTexture);
+#ifdef SNAKES_PROFILE
+        if (showProfileOverlay) renderProfileOverlay();
+#endif
+        SDL_RenderPresent(renderer);
     }
+    PROFILE_END_FRAME();
+}
+
+/******************************************
+*           offscreen capture             *
+*                                         *
+*  renders every captured frame into a    *
+*  surface and hands it to a FrameCapture *
+*******************************************/
 
-    orient();
+// With --capture there is no window. A capture simulation thread ticks the World as fast as it can, with no TICKDELAY, and publishes
+// a FrameSnapshot every every-th tick through captureExchange. The main thread draws the newest one with SDL's software renderer into
+// captureSurface, which is sized to show the whole board, and is the only thread that waits on the encoders when the FrameCapture's queue is full.
+// Snapshots published while it was waiting are skipped, so the simulation never slows down for the capture and the output drops frames instead
+SDL_Surface *captureSurface = nullptr;
+int const    CAPTURE_QUEUE_FRAMES = 16;
+// the longest side and the most pixels captureSurface may have. Every CapturedFrame of the queue is as big as it is,
+// so a capture of the largest size holds about a gigabyte of frames
+int const       MAX_CAPTURE_SIDE = 16384;
+long long const MAX_CAPTURE_PIXELS = 4096LL * 4096;
+
+// captureCellFor() is the largest cell size up to cell that shows a cols x rows board within MAX_CAPTURE_SIDE and MAX_CAPTURE_PIXELS,
+// 0 when even one pixel to a cell doesn't
+int captureCellFor(int cols, int rows, int cell) {
+    while (cell > 0 && ((long long)cols * cell > MAX_CAPTURE_SIDE || (long long)rows * cell > MAX_CAPTURE_SIDE ||
+                        (long long)cols * cell * rows * cell > MAX_CAPTURE_PIXELS)) {
+        --cell;
+    }
+    return cell;
 }
 
-std::vector<Snake> snakeMasterVec;
-Snake * snakeMasterArr = new Snake[]();
+// initOffscreen() creates captureSurface and a software renderer that draws into it, then the atlas and board textures as init() does
+bool initOffscreen() {
+    mapSpriteBundle();
+    SDL_Init(0);
+    captureSurface = SDL_CreateRGBSurface(0, windowWidth, windowHeight, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000);
+    if (captureSurface == nullptr) {
+        std::cout << "ERROR: capture surface == null: " << SDL_GetError() << std::endl;
+        return false;
+    }
+    renderer = SDL_CreateSoftwareRenderer(captureSurface);
+    if (renderer == nullptr) {
+        std::cout << "ERROR: software renderer == null: " << SDL_GetError() << std::endl;
+        return false;
+    }
+    initRenderTargets();
+    return true;
+}
 
-// iterates through the snakeMasterVec and erase() any Snake with .dieNextTick set to true
-void killSnakes() {
-    for (int i = 0; i < snakeMasterVec.size(); ++i) {
-        if (snakeMasterVec.at(i).dieNextTick) {
-            //snakeMasterVec.at(i).snakeVecMember.erase(snakeMasterVec.at(i).snakeVecMember.begin(), snakeMasterVec.at(i).snakeVecMember.end());
-            snakeMasterVec.erase(snakeMasterVec.begin() + i);
-        }
+// captureFrame() draws frame into captureSurface the way renderBoard() draws the window and queues a copy of its pixels
+void captureFrame(FrameCapture &capture, const FrameSnapshot &frame) {
+    renderBoard(frame);
+    CapturedFrame *captured = capture.nextFree();
+    SDL_LockSurface(captureSurface);
+    for (int y = 0; y < capture.height; ++y) {
+        std::memcpy(&captured->pixels[(size_t)y * capture.width], (const char *)captureSurface->pixels + y * captureSurface->pitch, capture.width * 4);
     }
+    SDL_UnlockSurface(captureSurface);
+    capture.submit(captured);
 }
 
-// collisionCheck() takes a pointer to a SDL_Rect and iterates through snakeMasterVec and iterates through snakeVecMember of each Snake
-// and uses SDL_HasIntersection to check if the passed in SDL_Rect and the sRect of each SnakePart intersects
-bool collisionCheck(SDL_Rect* rectCheck) {
-    for (auto snakeIt = snakeMasterVec.begin(); snakeIt != snakeMasterVec.end(); ++snakeIt) {
-        for (auto snakePartIt = snakeIt->snakeVecMember.begin(); snakePartIt != snakeIt->snakeVecMember.end(); ++snakePartIt) {
-            if (SDL_HasIntersection(rectCheck, &snakePartIt->sRect)) {
-                return true;
+// runCapture() captures the board as it starts and then after every every-th one of ticks game ticks, waits for the encoders
+// and prints how much faster than the game itself that ran. Every snapshot carries the dirty cells of all the ticks since the one before,
+// so the boardTexture is only redrawn where the board changed, unless the main thread skipped the snapshot before and redraws it all
+bool runCapture(FrameCapture &capture, int ticks, int every) {
+    typedef std::chrono::steady_clock captureClock;
+    captureClock::time_point start = captureClock::now();
+    FrameExchange           captureExchange;
+    std::mutex              publishMutex;
+    std::condition_variable published;
+    uint64_t                publishedSequence = 0;
+    bool                    simulationDone = false;
+    double                  simulationSeconds = 0;
+
+    // the capture simulation thread only takes publishMutex to say what it published, it never waits for the main thread
+    std::thread simulation([&] {
+        uint64_t sequence = 0;
+        auto publish = [&] {
+            captureExchange.back().build(world, ++sequence, captureExchange.boardParts);
+            captureExchange.publish();
+            {
+                std::lock_guard<std::mutex> lock(publishMutex);
+                publishedSequence = sequence;
             }
+            published.notify_one();
+        };
+        publish();
+        for (int tick = 1; tick <= ticks; ++tick) {
+            world.gameTick();
+            if (tick % every == 0) publish();
+        }
+        std::chrono::duration<double> elapsed = captureClock::now() - start;
+        {
+            std::lock_guard<std::mutex> lock(publishMutex);
+            simulationSeconds = elapsed.count();
+            simulationDone = true;
+        }
+        published.notify_one();
+    });
+
+    // the last snapshot is published before simulationDone is set, so the acquire() after seeing it set gets that one if nothing before did
+    uint64_t  seenSequence = 0;
+    uint64_t  capturedSequence = 0;
+    long long skipped = 0;
+    bool      done = false;
+    while (!done) {
+        {
+            std::unique_lock<std::mutex> lock(publishMutex);
+            published.wait(lock, [&] { return simulationDone || publishedSequence != seenSequence; });
+            seenSequence = publishedSequence;
+            done = simulationDone;
+        }
+        if (captureExchange.acquire()) {
+            const FrameSnapshot &frame = captureExchange.front();
+            skipped += (long long)(frame.sequence - capturedSequence - 1);
+            capturedSequence = frame.sequence;
+            captureFrame(capture, frame);
         }
     }
-    return false;
+    simulation.join();
+    bool written = capture.finish();
+    std::chrono::duration<double> elapsed = captureClock::now() - start;
+
+    double seconds = elapsed.count();
+    std::cout << "simulated " << ticks << " ticks in " << simulationSeconds << " s, " << (simulationSeconds > 0 ? ticks / simulationSeconds : 0) << " ticks/sec, "
+              << (simulationSeconds > 0 ? ticks * (TICKDELAY / 1000.0) / simulationSeconds : 0) << "x real time" << std::endl;
+    std::cout << "captured " << capture.framesWritten << " frames of " << capture.width << "x" << capture.height << " in " << seconds << " s, skipped "
+              << skipped << " of " << capturedSequence << " snapshots, queue full " << capture.producerWaits << " times" << std::endl;
+    return written;
 }
 
-// This collisionCheck() checks the color of the passed in snake against the snake that intersects with the rect that was passed in. if so then that snake's dieNextTick bool = true
-bool collisionCheck(SDL_Rect* rectCheck, Snake snake, bool * didSnakeDie) {
-    for (auto snakeIt = snakeMasterVec.begin(); snakeIt != snakeMasterVec.end(); ++snakeIt) {
-        for (auto snakePartIt = snakeIt->snakeVecMember.begin(); snakePartIt != snakeIt->snakeVecMember.end(); ++snakePartIt) {
-            if (SDL_HasIntersection(rectCheck, &snakePartIt->sRect)) {
-                if (snakeIt->id == snake.id) {
-                    return true;
-                }
-                if (snakePartIt->color == snake.color) {
-                    snakeIt->dieNextTick = true;
-                    *didSnakeDie = true;
-                }
-                return true;
+int main(int argc, char* argv[]) {
+    // savageSnakes --headless <seed> <cols> <rows> <ticks> [threads] runs the simulation without SDL and prints ticks/sec and the final state hash
+    if ((argc == 6 || argc == 7) && std::string(argv[1]) == "--headless") {
+        int threads = argc == 7 ? std::stoi(argv[6]) : 1;
+        runHeadless((unsigned int)std::stoul(argv[2]), std::stoi(argv[3]), std::stoi(argv[4]), std::stoi(argv[5]), threads);
+        return 0;
+    }
+    // savageSnakes --replay <snapshot> <inputlog or -> <ticks> [threads] plays on from a snapshot without SDL, applying the logged inputs
+    if ((argc == 5 || argc == 6) && std::string(argv[1]) == "--replay") {
+        int threads = argc == 6 ? std::stoi(argv[5]) : 1;
+        runReplay(argv[2], argv[3], std::stoi(argv[4]), threads);
+        return 0;
+    }
+
+    // savageSnakes [--board <cols> <rows>] [--snakes <count>] [--threads <count>] [--trace <firstTick> <lastTick> <file>] plays on a board of any size,
+    // the window shows the part the camera is on. Without --board the board is exactly the window.
+    // --trace writes a chrome trace of the given ticks, it needs a build with SNAKES_PROFILE.
+    // --record <name> saves the starting board to <name>.snk and logs every input to <name>.inputs, --load <snapshot> carries on from a snapshot.
+    // --capture <raw|png|y4m> <output> <ticks> plays ticks ticks without a window and writes the whole board out as frames, see frameCapture.h,
+    // every --every <ticks> ticks, --cell <pixels> to a cell, encoded on --encoders <count> threads. The simulation never waits for the capture,
+    // a frame that comes in while the encoders are behind replaces the one before it. --seed <seed> makes a run repeatable
+    int cols = windowWidth / SNAKEPART_SIZE;
+    int rows = windowHeight / SNAKEPART_SIZE;
+    int startingSnakes = 1;
+    int threads = 1;
+    bool record = false;
+    std::string loadFile;
+    unsigned int seed = (unsigned int)std::chrono::system_clock::now().time_since_epoch().count();
+    bool capture = false;
+    int captureFormat = CAPTURE_PNG;
+    std::string captureOutput;
+    int captureTicks = 0;
+    int captureEvery = 1;
+    int captureCell = SNAKEPART_SIZE;
+    int encoderCount = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--board" && i + 2 < argc) {
+            cols = std::stoi(argv[++i]);
+            rows = std::stoi(argv[++i]);
+        } else if (arg == "--snakes" && i + 1 < argc) {
+            startingSnakes = std::stoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = std::stoi(argv[++i]);
+        } else if (arg == "--record" && i + 1 < argc) {
+            recordName = argv[++i];
+            record = true;
+        } else if (arg == "--load" && i + 1 < argc) {
+            loadFile = argv[++i];
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = (unsigned int)std::stoul(argv[++i]);
+        } else if (arg == "--capture" && i + 3 < argc) {
+            if (!parseCaptureFormat(argv[++i], captureFormat)) {
+                std::cout << "--capture takes raw, png or y4m, not " << argv[i] << std::endl;
+                return 1;
             }
+            captureOutput = argv[++i];
+            captureTicks = std::stoi(argv[++i]);
+            capture = true;
+        } else if (arg == "--every" && i + 1 < argc) {
+            captureEvery = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--cell" && i + 1 < argc) {
+            captureCell = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--encoders" && i + 1 < argc) {
+            encoderCount = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--trace" && i + 3 < argc) {
+            int firstTick = std::stoi(argv[++i]);
+            int lastTick = std::stoi(argv[++i]);
+            std::string file = argv[++i];
+#ifdef SNAKES_PROFILE
+            profiler.traceTicks(firstTick, lastTick, file);
+#else
+            std::cout << "--trace " << firstTick << " " << lastTick << " " << file << " ignored, built without SNAKES_PROFILE" << std::endl;
+#endif
+        } else {
+            std::cout << "unknown option " << arg << std::endl;
+            return 1;
         }
-    } 
-    return false;
-}
-
-// Calls either of the collisionCheck() functions and if there is a collision it will check around the head of the snake
-//to see if there are any open spaces and if there are the snake will change directions to keep moving until
-//no open spaces are available.
-
-bool Snake::collisionSnakeCheck() {
-    bool snakeKilled = false;
-    SDL_Rect checkRect;
-    checkRect.h = SNAKEPART_SIZE;
-    checkRect.w = SNAKEPART_SIZE;
-    SDL_Rect checkEastRect;
-    checkEastRect.h = SNAKEPART_SIZE;
-    checkEastRect.w = SNAKEPART_SIZE;
-    SDL_Rect checkWestRect;
-    checkWestRect.h = SNAKEPART_SIZE;
-    checkWestRect.w = SNAKEPART_SIZE;
-    SDL_Rect checkSouthRect;
-    checkSouthRect.h = SNAKEPART_SIZE;
-    checkSouthRect.w = SNAKEPART_SIZE;
-   
-    checkRect.x = snakeVecMember.at(0).sRect.x + vel.x;
-    checkRect.y = snakeVecMember.at(0).sRect.y + vel.y;
-
-    checkEastRect.x = snakeVecMember.at(0).sRect.x + SNAKEPART_SIZE;
-    checkEastRect.y = snakeVecMember.at(0).sRect.y + 0;
-
-    checkWestRect.x = snakeVecMember.at(0).sRect.x - SNAKEPART_SIZE;
-    checkWestRect.y = snakeVecMember.at(0).sRect.y + 0;
-
-    checkSouthRect.x = snakeVecMember.at(0).sRect.x + 0;
-    checkSouthRect.y = snakeVecMember.at(0).sRect.y + SNAKEPART_SIZE;
-
-    //If there was a collision last tick, and it killed the snake so now there is no collision, move to the south OR if there was a collision last tick and there is another collision this tick and the snake dies then move to the south 
-    if (wantsSouth == true && !collisionCheck(&checkSouthRect) && checkRect.y < windowHeight - SNAKEPART_SIZE || wantsSouth == true && collisionCheck(&checkSouthRect, *this, &snakeKilled) && snakeKilled == true && checkRect.y < windowHeight - SNAKEPART_SIZE) {
-        vel.x = 0;
-        vel.y = SNAKEPART_SIZE;
-        direction = SOUTH;
-        wantsSouth = false;
-    }
-
-    // Is there a collision?
-    if (collisionCheck(&checkRect, *this, &snakeKilled) || checkRect.x < 0 || checkRect.x > windowWidth - SNAKEPART_SIZE || checkRect.y > windowHeight - SNAKEPART_SIZE) {
-        if (snakeKilled) {
-            return false;
-        } 
-            //Is there space to the South?
-            if (!collisionCheck(&checkSouthRect) && checkRect.y < windowHeight - SNAKEPART_SIZE) {
-                vel.x = 0;
-                vel.y = SNAKEPART_SIZE;
-                direction = SOUTH;
-                //Is there space to the West?
-            } else if (!collisionCheck(&checkWestRect) && checkRect.x > 0 || collisionCheck(&checkWestRect, *this, &snakeKilled) && snakeKilled == true && checkRect.x > 0) {
-                vel.x = -SNAKEPART_SIZE;
-                vel.y = 0;
-                direction = WEST;
-                wantsSouth = true;
-                //Is there space to the East?
-            } else if (!collisionCheck(&checkEastRect) && checkRect.x < windowWidth - SNAKEPART_SIZE || collisionCheck(&checkEastRect, *this, &snakeKilled) && snakeKilled == true && checkRect.x < windowWidth - SNAKEPART_SIZE) {
-                vel.x = SNAKEPART_SIZE;
-                vel.y = 0;
-                direction = EAST;
-                wantsSouth = true;
-                //If there are no open spaces then return true; there is a full collision.
-            }else return true;
-    }
-    return false;
-}
-
-//returns a Snake Object
-Snake snakeMakerFunc() {
-    Snake snake;
-    return snake;
-}
+    }
 
-int main(int argc, char* argv[]) {
-    init();
+    world.setTickThreads(threads);
+    if (!loadFile.empty()) {
+        uint32_t savedInputs;
+        if (!loadSnapshot(world, loadFile, &savedInputs)) return 1;
+    } else {
+        world.resetSimulation(seed, cols, rows);
+        world.snakeMasterVec.reserve(startingSnakes);
+        for (int i = 0; i < startingSnakes; ++i) {
+            world.snakeMasterVec.push_back(Snake(world));
+        }
+    }
+    if (record) {
+        if (!saveSnapshot(world, recordName + ".snk", 0) || !inputLog.open(recordName + ".inputs")) return 1;
+    }
+    // the simulation collects the dirty cells of the whole board, the main thread leaves out the ones that are off screen when it draws
+    world.dirtyRegion.x = 0;
+    world.dirtyRegion.y = 0;
+    world.dirtyRegion.w = world.boardCols;
+    world.dirtyRegion.h = world.boardRows;
+    cameraMoved();
+
+    if (capture) {
+        int fittingCell = captureCellFor(world.boardCols, world.boardRows, captureCell);
+        if (fittingCell == 0) {
+            std::cout << "ERROR: a " << world.boardCols << "x" << world.boardRows << " board doesn't fit in a capture of at most " << MAX_CAPTURE_SIDE
+                      << " pixels a side and " << MAX_CAPTURE_PIXELS << " pixels even at --cell 1" << std::endl;
+            return 1;
+        }
+        if (fittingCell < captureCell) {
+            std::cout << "--cell " << captureCell << " makes a " << world.boardCols << "x" << world.boardRows << " board too big to capture, capturing at --cell "
+                      << fittingCell << std::endl;
+            captureCell = fittingCell;
+        }
+        camera.cellPixels = captureCell;
+        windowWidth = world.boardCols * captureCell;
+        windowHeight = world.boardRows * captureCell;
+        if (!initOffscreen()) return 1;
+        FrameCapture frameCapture;
+        if (!frameCapture.start(captureFormat, captureOutput, windowWidth, windowHeight, 1000, TICKDELAY * captureEvery, CAPTURE_QUEUE_FRAMES, encoderCount)) return 1;
+        bool written = runCapture(frameCapture, captureTicks, captureEvery);
+        SDL_DestroyTexture(boardTexture);
+        SDL_DestroyTexture(frozenTexture);
+        spriteAtlas.destroy();
+        SDL_DestroyRenderer(renderer);
+        SDL_FreeSurface(captureSurface);
+        return written ? 0 : 1;
+    }
 
-    snakeMasterVec.push_back(Snake());
+    init();
 
-    int const TICKDELAY = 100;
-    bool addSnake = false;
-    SDL_Rect startingRect;
-    startingRect.h = SNAKEPART_SIZE;
-    startingRect.w = SNAKEPART_SIZE;
-    startingRect.x = 200;
-    startingRect.y = 0;
+    Uint32 registered = SDL_RegisterEvents(1);
+    if (registered != (Uint32)-1) frameReadyEvent = registered;
+    std::thread simulation(simulationLoop);
 
-    SDL_TimerID my_timer_id = 0;
-    my_timer_id = SDL_AddTimer(TICKDELAY, tickCallBack, NULL); 
+    // The main thread draws at most once per display frame and only when a new FrameSnapshot came in or the camera moved,
+    // and sleeps in SDL_WaitEventTimeout() until then, the simulation thread's frameReadyEvent and the player's input both wake it
+    Uint64 const countsPerMs = SDL_GetPerformanceFrequency() / 1000;
+    Uint64 const frameCounts = displayFrameCounts();
+    Uint64 nextFrame = SDL_GetPerformanceCounter();
+    Uint64 nextStatsTitle = nextFrame + countsPerMs * 1000;
+    bool   boardChanged = true;
 
     while (running) {
-        while(SDL_PollEvent(&e)) {
-            if (e.type == SDL_QUIT) {
-                running = 0;
-                break;
-            } else if (e.type == SDL_KEYDOWN) {
-                if (!snakeMasterVec.empty()) {
-                    if (e.key.keysym.sym == SDLK_UP) {
-                        snakeMasterVec.erase(snakeMasterVec.begin());
-                    } else if (e.key.keysym.sym == SDLK_LEFT) {
-                        snakeMasterVec.back().vel.x = -SNAKEPART_SIZE;
-                        snakeMasterVec.back().vel.y =  0;
-                        snakeMasterVec.back().direction = WEST;
-                    } else if (e.key.keysym.sym == SDLK_DOWN) {
-                        snakeMasterVec.back().vel.x = 0;
-                        snakeMasterVec.back().vel.y = SNAKEPART_SIZE;
-                        snakeMasterVec.back().direction = SOUTH;
-                    } else if (e.key.keysym.sym == SDLK_RIGHT) {
-                        snakeMasterVec.back().vel.x = SNAKEPART_SIZE;
-                        snakeMasterVec.back().vel.y = 0;
-                        snakeMasterVec.back().direction = EAST;
-                    } else if (e.key.keysym.sym == SDLK_DELETE){
-                        snakeMasterVec.erase(snakeMasterVec.begin());
-                    }
-                }
-                if (e.key.keysym.sym == SDLK_RETURN) {
-                    snakeMasterVec.push_back(Snake());
-                }
-            } else if (e.type = SDL_USEREVENT) {
-                if (e.user.code == GAME_TICK) {
-                    for (auto it = snakeMasterVec.begin(); it != snakeMasterVec.end(); ++it) {
-                        if (!it->collisionSnakeCheck()) {
-                            addSnake = false;
-                            it->move();
-                        } else addSnake = true;
-                    }
-                    killSnakes();
-                    if (addSnake) {
-                        if (!collisionCheck(&startingRect)) {
-                            snakeMasterVec.emplace_back(Snake());
-                        }
-                    }
-                }
-            }
-            SDL_RenderClear(renderer);
-            for (auto it = snakeMasterVec.begin(); it != snakeMasterVec.end(); ++it){
-                it->render();
-            }
-            SDL_RenderPresent(renderer);
+        Uint64 now = SDL_GetPerformanceCounter();
+        Uint64 wakeAt = boardChanged ? std::min(nextFrame, nextStatsTitle) : nextStatsTitle;
+        int waitMs = wakeAt > now ? (int)((wakeAt - now) / countsPerMs) : 0;
+        if (waitMs > 0 ? SDL_WaitEventTimeout(&e, waitMs) : SDL_PollEvent(&e)) {
+            do {
+                handleEvent(e);
+                boardChanged = true;
+            } while (SDL_PollEvent(&e));
+        }
+        if (frameExchange.acquire()) {
+            boardChanged = true;
+        }
+
+        // front() is an empty FrameSnapshot with sequence 0 until the simulation thread published its first one
+        now = SDL_GetPerformanceCounter();
+        if (boardChanged && now >= nextFrame && frameExchange.front().sequence > 0) {
+            renderBoard(frameExchange.front());
+            boardChanged = false;
+            nextFrame = now + frameCounts;
+        }
+
+        if (now >= nextStatsTitle) {
+            std::string title = "Snakes - " + tickStats.summary();
+#ifdef SNAKES_PROFILE
+            if (showProfileOverlay) title += " |" + profileSummary();
+#endif
+            SDL_SetWindowTitle(window, title.c_str());
+            nextStatsTitle = now + countsPerMs * 1000;
         }
     }
+
+    {
+        std::lock_guard<std::mutex> lock(simMutex);
+        simQuitting = true;
+    }
+    simWake.notify_one();
+    simulation.join();
+    tickStats.print();
+    SDL_DestroyTexture(boardTexture);
+    SDL_DestroyTexture(frozenTexture);
+    spriteAtlas.destroy();
     return 0;
-}
\ No newline at end of file
+}
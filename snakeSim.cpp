@@ -0,0 +1,1063 @@
+#include "snakeSim.h"
+#include "profiler.h"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+
+int const directionStepX[] = { 0, 1, 0, -1 };
+int const directionStepY[] = { -1, 0, 1, 0 };
+
+/******************************************
+*              World class                *
+*******************************************/
+
+// a new World has the 20 x 32 window board, empty and ready for Snakes, and its rng seeded from the clock
+World::World()
+    : snakeID(0), boardCols(20), boardRows(32), spawnCheckX(spawnCheckColumn(20)), spawnCheckY(0), addSnake(false), tickNumber(0), trackDirtyCells(false),
+      startingXRange(0, 20), lengthRange(3, 10), colorRange(0, SNAKE_COLOR_COUNT), rng((unsigned int)std::chrono::system_clock::now().time_since_epoch().count()) {
+    dirtyRegion.x = 0;
+    dirtyRegion.y = 0;
+    dirtyRegion.w = 0;
+    dirtyRegion.h = 0;
+    std::memset(&stats, 0, sizeof(stats));
+    stats.filledTick = -1;
+    occupancyGrid.world = this;
+    frozenLayer.world = this;
+    partStore.reset((int)lengthRange.max());
+    occupancyGrid.reset(boardCols, boardRows, 1, (int)lengthRange.max());
+}
+
+World::~World() {
+    tickWorkers.stop();
+    snakeMasterVec.clear();
+    frozenLayer.clear();
+}
+
+/******************************************
+*            PartStore class              *
+*******************************************/
+
+void PartStore::reset(int partsPerSnake) {
+    capacity = partsPerSnake;
+    cellX.clear();
+    cellY.clear();
+    state.clear();
+    freeSlots.clear();
+}
+
+// allocSlot() returns a free slot, growing the arrays by one slot when none has been freed.
+// freeSlots is a stack, so a spawn reuses the slot of the Snake that died last, which is still in the cache
+int PartStore::allocSlot() {
+    if (!freeSlots.empty()) {
+        int slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+    int slot = (int)cellX.size() / capacity;
+    cellX.resize(cellX.size() + capacity);
+    cellY.resize(cellY.size() + capacity);
+    state.resize(state.size() + capacity);
+    return slot;
+}
+
+void PartStore::freeSlot(int slot) {
+    freeSlots.push_back(slot);
+}
+
+/******************************************
+*          OccupancyGrid class            *
+*******************************************/
+
+// reset() sizes the grid to the board plus a margin on the sides and on top, where new snakes keep their tails until they have crawled in
+void OccupancyGrid::reset(int boardCols, int boardRows, int marginCols, int marginTopRows) {
+    GridCell empty;
+    empty.count = 0;
+
+    originX = -marginCols;
+    originY = -marginTopRows;
+    cols = boardCols + 2 * marginCols;
+    rows = boardRows + marginTopRows + 1;
+    chunkCols = (cols + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+    chunkRows = (rows + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+    cells.assign(chunkCols * chunkRows * CHUNK_CELLS, empty);
+    chunkParts.assign(chunkCols * chunkRows, 0);
+    filledCells = 0;
+    wordsPerRow = (cols + 63) >> 6;
+    planes.assign(rows * PLANE_COUNT * wordsPerRow, 0);
+    overflow.clear();
+    claimedTick.assign(cells.size(), -1);
+    changedTick.assign(cells.size(), -1);
+    watchers.assign(cells.size(), 0);
+    watcherIds.assign(cells.size() * MAX_WATCHERS, 0);
+}
+
+// cellIndex() returns the index into cells for board cell x, y or -1 if it is outside of the grid.
+// The chunk comes first and the cell inside the chunk second, so neighbouring cells mostly share a chunk and a cache line
+int OccupancyGrid::cellIndex(int x, int y) const {
+    x -= originX;
+    y -= originY;
+    if (x < 0 || x >= cols || y < 0 || y >= rows) return -1;
+    int chunk = (y >> CHUNK_SHIFT) * chunkCols + (x >> CHUNK_SHIFT);
+    return chunk * CHUNK_CELLS + ((y & (CHUNK_SIZE - 1)) << CHUNK_SHIFT) + (x & (CHUNK_SIZE - 1));
+}
+
+int OccupancyGrid::chunkIndex(int chunkX, int chunkY) const {
+    return chunkY * chunkCols + chunkX;
+}
+
+void OccupancyGrid::occupy(int x, int y, int id, int color) {
+    int index = cellIndex(x, y);
+    if (index < 0) return;
+    GridCell &cell = cells[index];
+    Occupant occupant;
+    occupant.snakeId = id;
+    occupant.color = color;
+    if (cell.count < 2) {
+        cell.occupants[cell.count] = occupant;
+    } else {
+        overflow.insert(std::make_pair(index, occupant));
+    }
+    if (cell.count == 0 && onBoard(x, y)) ++filledCells;
+    ++cell.count;
+    ++chunkParts[index / CHUNK_CELLS];
+    touched(index);
+
+    uint64_t bit = 1ULL << ((x - originX) & 63);
+    planeWord(ANY_PLANE, x - originX, y - originY) |= bit;
+    planeWord(color, x - originX, y - originY) |= bit;
+}
+
+// vacate() takes one SnakePart of Snake id out of cell x, y. An inline hole is filled from overflow first so the inline occupants stay packed.
+// The color's plane bit is cleared once no SnakePart of that color is left in the cell
+void OccupancyGrid::vacate(int x, int y, int id) {
+    int index = cellIndex(x, y);
+    if (index < 0 || cells[index].count == 0) return;
+    GridCell &cell = cells[index];
+
+    int removedColor = -1;
+    int inlineCount = std::min(cell.count, 2);
+    for (int i = 0; i < inlineCount && removedColor < 0; ++i) {
+        if (cell.occupants[i].snakeId != id) continue;
+        removedColor = cell.occupants[i].color;
+        auto spill = cell.count > 2 ? overflow.find(index) : overflow.end();
+        if (spill != overflow.end()) {
+            cell.occupants[i] = spill->second;
+            overflow.erase(spill);
+        } else if (i == 0 && inlineCount == 2) {
+            cell.occupants[0] = cell.occupants[1];
+        }
+    }
+    if (removedColor < 0) {
+        auto range = overflow.equal_range(index);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second.snakeId == id) {
+                removedColor = it->second.color;
+                overflow.erase(it);
+                break;
+            }
+        }
+    }
+    if (removedColor < 0) return;
+    --cell.count;
+    if (cell.count == 0 && onBoard(x, y)) --filledCells;
+    --chunkParts[index / CHUNK_CELLS];
+    touched(index);
+
+    bool colorLeft = false;
+    for (int i = 0; i < std::min(cell.count, 2); ++i) {
+        colorLeft = colorLeft || cell.occupants[i].color == removedColor;
+    }
+    if (cell.count > 2 && !colorLeft) {
+        auto range = overflow.equal_range(index);
+        for (auto it = range.first; it != range.second; ++it) {
+            colorLeft = colorLeft || it->second.color == removedColor;
+        }
+    }
+    uint64_t bit = 1ULL << ((x - originX) & 63);
+    if (!colorLeft) planeWord(removedColor, x - originX, y - originY) &= ~bit;
+    if (cell.count == 0) planeWord(ANY_PLANE, x - originX, y - originY) &= ~bit;
+}
+
+// touched() notes that a SnakePart came into or left cells[index], and wakes the frozen Snakes whose heads are next to it
+void OccupancyGrid::touched(int index) {
+    changedTick[index] = world->tickNumber;
+    if (watchers[index] != 0) world->frozenLayer.cellChanged(index);
+}
+
+// lowestOccupant() returns the occupant of cells[index] with the lowest snake id, false if the cell is empty
+bool OccupancyGrid::lowestOccupant(int index, Occupant *found) const {
+    const GridCell &cell = cells[index];
+    if (cell.count == 0) return false;
+    *found = cell.occupants[0];
+    if (cell.count > 1 && cell.occupants[1].snakeId < found->snakeId) {
+        *found = cell.occupants[1];
+    }
+    if (cell.count > 2) {
+        auto range = overflow.equal_range(index);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second.snakeId < found->snakeId) *found = it->second;
+        }
+    }
+    return true;
+}
+
+// occupantsAt() copies up to maxCount of the occupants of cell x, y into found and returns how many it copied
+int OccupancyGrid::occupantsAt(int x, int y, Occupant *found, int maxCount) const {
+    int index = cellIndex(x, y);
+    if (index < 0) return 0;
+    const GridCell &cell = cells[index];
+    int copied = 0;
+    for (int i = 0; i < std::min(cell.count, 2) && copied < maxCount; ++i) {
+        found[copied++] = cell.occupants[i];
+    }
+    if (cell.count > 2) {
+        auto range = overflow.equal_range(index);
+        for (auto it = range.first; it != range.second && copied < maxCount; ++it) {
+            found[copied++] = it->second;
+        }
+    }
+    return copied;
+}
+
+// neighborMask() reads the four neighbours of cell x, y out of the planes for a Snake of the given color, see neighborOccupied()
+uint8_t OccupancyGrid::neighborMask(int x, int y, int color) const {
+    int gridX = x - originX;
+    int gridY = y - originY;
+    uint8_t mask = 0;
+    for (int d = NORTH; d <= WEST; ++d) {
+        int nx = gridX + directionStepX[d];
+        int ny = gridY + directionStepY[d];
+        if (nx < 0 || nx >= cols || ny < 0 || ny >= rows) {
+            mask |= 16 << d;
+            continue;
+        }
+        mask |= planeBit(ANY_PLANE, nx, ny) << d;
+        mask |= planeBit(color, nx, ny) << (4 + d);
+    }
+    return mask;
+}
+
+// claim() marks cell x, y as taken for this tick, returns false if another Snake already claimed it.
+// Cells outside of the grid can't be claimed and always return true
+bool OccupancyGrid::claim(int x, int y, int tick) {
+    int index = cellIndex(x, y);
+    if (index < 0) return true;
+    if (claimedTick[index] == tick) return false;
+    claimedTick[index] = tick;
+    return true;
+}
+
+void World::markDirty(int x, int y) {
+    if (!trackDirtyCells) return;
+    if (x < dirtyRegion.x || x >= dirtyRegion.x + dirtyRegion.w || y < dirtyRegion.y || y >= dirtyRegion.y + dirtyRegion.h) return;
+    CellRef cell;
+    cell.x = (int16_t)x;
+    cell.y = (int16_t)y;
+    dirtyCells.push_back(cell);
+}
+
+/******************************************
+*               Snake class               *
+*******************************************/
+
+Snake::Snake(World &world) : world(&world) {
+    id = world.snakeID;
+    headIndex = 0;
+    direction = SOUTH;
+    length = world.lengthRange(world.rng);
+    dieNextTick = false;
+    wantsSouth = false;
+    stuckTicks = 0;
+    color = world.colorRange(world.rng);
+    createSnakeParts(length, color);
+    arrangeSnakeParts();
+    ++world.snakeID;
+}
+
+// createSnakeParts takes a slot in the PartStore and sets the direction, corner and color of every SnakePart in it
+void Snake::createSnakeParts(int length, int color) {
+    PartStore &partStore = world->partStore;
+    slot = partStore.allocSlot();
+    for (int i = 0; i < length; ++i) {
+        partStore.state[part(i)] = packState(SOUTH, NO_CORNER, color);
+    }
+}
+
+// arrangeSnakeParts() sets the starting cell of every SnakePart, the head on the top row and the rest stacked above the window
+void Snake::arrangeSnakeParts() {
+    PartStore &partStore = world->partStore;
+    PROFILE_COUNT(COUNTER_SPAWNS, 1);
+    ++world->stats.spawns;
+    for (int i = 0; i < length; ++i) {
+        int p = part(i);
+        partStore.cellX[p] = (int16_t)world->startingXRange(world->rng);
+        partStore.cellY[p] = (int16_t)-i;
+        world->occupancyGrid.occupy(partStore.cellX[p], partStore.cellY[p], id, color);
+        world->markDirty(partStore.cellX[p], partStore.cellY[p]);
+    }
+}
+
+// orient() sets the direction and corner of the SnakeParts, gets called at the end of the Snake::move() function.
+// Every SnakePart takes over the direction of the SnakePart in front of it, which the ring buffer already did by moving headIndex,
+// and every corner is worked out from the two directions that moved along with it. That leaves only the head, the neck and the tail to fix up:
+// the head gets the snake's direction, the neck gets a corner between the head and itself, and the tail copies the part in front of it with no corner
+void Snake::orient() {
+    PartStore &partStore = world->partStore;
+    int headPart = part(0);
+    int neckPart = part(1);
+    int tailPart = part(length - 1);
+    int neckDirection = stateDirection(partStore.state[neckPart]);
+
+    partStore.state[headPart] = packState(direction, NO_CORNER, color);
+    partStore.state[neckPart] = packState(neckDirection, cornerBetween(direction, neckDirection), color);
+    partStore.state[tailPart] = packState(stateDirection(partStore.state[part(length - 2)]), NO_CORNER, color);
+}
+
+// move() steps the head one cell in Snake::direction. The old tail's slot becomes the new head by moving headIndex back one slot,
+// every other SnakePart keeps its cell and so ends up one place further back in the snake. Only the vacated tail cell and the new head cell change in occupancyGrid,
+// and besides those two only the old head (now the neck) and the new tail look different
+void Snake::move() {
+    PartStore &partStore = world->partStore;
+    int oldHead = head();
+    headIndex = (headIndex + length - 1) % length;
+    int newHead = head();
+
+    world->occupancyGrid.vacate(partStore.cellX[newHead], partStore.cellY[newHead], id);
+    world->markDirty(partStore.cellX[newHead], partStore.cellY[newHead]);
+    partStore.cellX[newHead] = partStore.cellX[oldHead] + directionStepX[direction];
+    partStore.cellY[newHead] = partStore.cellY[oldHead] + directionStepY[direction];
+    world->occupancyGrid.occupy(partStore.cellX[newHead], partStore.cellY[newHead], id, color);
+    PROFILE_COUNT(COUNTER_MOVES, 1);
+
+    orient();
+
+    int newTail = part(length - 1);
+    world->markDirty(partStore.cellX[newHead], partStore.cellY[newHead]);
+    world->markDirty(partStore.cellX[oldHead], partStore.cellY[oldHead]);
+    world->markDirty(partStore.cellX[newTail], partStore.cellY[newTail]);
+}
+
+// vacateBoard() takes all of the snake's SnakeParts out of occupancyGrid and hands its slot back to the PartStore, call it before the Snake leaves snakeMasterVec.
+// Afterwards the Snake has no slot (-1) and no parts to look at
+void Snake::vacateBoard() {
+    PartStore &partStore = world->partStore;
+    for (int i = 0; i < length; ++i) {
+        world->occupancyGrid.vacate(partStore.cellX[part(i)], partStore.cellY[part(i)], id);
+        world->markDirty(partStore.cellX[part(i)], partStore.cellY[part(i)]);
+    }
+    partStore.freeSlot(slot);
+    slot = -1;
+}
+
+Snake::Snake(World &world, int id, int length, int color)
+    : world(&world), id(id), length(length), headIndex(0), direction(SOUTH), color(color), wantsSouth(false), dieNextTick(false), stuckTicks(0) {
+    createSnakeParts(length, color);
+}
+
+Snake::Snake(Snake &&other)
+    : world(other.world), id(other.id), length(other.length), headIndex(other.headIndex), slot(other.slot), direction(other.direction),
+      color(other.color), wantsSouth(other.wantsSouth), dieNextTick(other.dieNextTick), stuckTicks(other.stuckTicks) {
+    other.slot = -1;
+}
+
+Snake & Snake::operator=(Snake &&other) {
+    if (this != &other) {
+        if (slot >= 0) vacateBoard();
+        world = other.world;
+        id = other.id;
+        length = other.length;
+        headIndex = other.headIndex;
+        slot = other.slot;
+        direction = other.direction;
+        color = other.color;
+        wantsSouth = other.wantsSouth;
+        dieNextTick = other.dieNextTick;
+        stuckTicks = other.stuckTicks;
+        other.slot = -1;
+    }
+    return *this;
+}
+
+Snake::~Snake() {
+    if (slot >= 0) vacateBoard();
+}
+
+// killSnakes() removes every Snake with .dieNextTick set in one pass, sliding the survivors down in order so snakeMasterVec stays sorted by id.
+// The dead Snakes' slots go on the PartStore free list for the next spawn and the vector keeps its capacity, so neither dying nor spawning allocates.
+// The frozen Snakes that were killed go after them
+void World::killSnakes() {
+    size_t kept = 0;
+    for (size_t i = 0; i < snakeMasterVec.size(); ++i) {
+        Snake &snake = snakeMasterVec[i];
+        if (snake.dieNextTick) {
+            if (snake.slot >= 0) snake.vacateBoard();
+            PROFILE_COUNT(COUNTER_KILLS, 1);
+            ++stats.kills[snake.color];
+        } else {
+            if (kept != i) snakeMasterVec[kept] = std::move(snake);
+            ++kept;
+        }
+    }
+    snakeMasterVec.erase(snakeMasterVec.begin() + kept, snakeMasterVec.end());
+    frozenLayer.killDying();
+}
+
+// applyInput() does what one of the player's inputActions asks for: remove the oldest Snake still on the board,
+// steer the newest Snake, or spawn a Snake. A frozen Snake is thawed before it is removed or steered
+void World::applyInput(int action) {
+    if (action == INPUT_SPAWN) {
+        snakeMasterVec.push_back(Snake(*this));
+        return;
+    }
+    if (snakeCount() == 0) return;
+    if (action == INPUT_REMOVE_OLDEST) {
+        Snake *oldest = nullptr;
+        for (auto it = snakeMasterVec.begin(); it != snakeMasterVec.end() && oldest == nullptr; ++it) {
+            if (it->slot >= 0) oldest = &*it;
+        }
+        if (!frozenLayer.frozen.empty() && (oldest == nullptr || frozenLayer.frozen.front().id < oldest->id)) {
+            oldest = frozenLayer.thaw(frozenLayer.frozen.front().id);
+        }
+        if (oldest != nullptr) removeSnake(*oldest);
+        return;
+    }
+    Snake *newest = snakeMasterVec.empty() ? nullptr : &snakeMasterVec.back();
+    if (!frozenLayer.frozen.empty() && (newest == nullptr || frozenLayer.frozen.back().id > newest->id)) {
+        newest = frozenLayer.thaw(frozenLayer.frozen.back().id);
+    }
+    if (action == INPUT_STEER_WEST) {
+        newest->direction = WEST;
+    } else if (action == INPUT_STEER_SOUTH) {
+        newest->direction = SOUTH;
+    } else if (action == INPUT_STEER_EAST) {
+        newest->direction = EAST;
+    }
+}
+
+// removeSnake() takes a Snake off the board straight away and marks it dead, it leaves snakeMasterVec with the other dead Snakes at the end of the tick
+void removeSnake(Snake &snake) {
+    if (snake.slot < 0) return;
+    snake.vacateBoard();
+    snake.dieNextTick = true;
+}
+
+// snakeById() finds a Snake in snakeMasterVec. Snakes are only ever appended with increasing ids and erasing keeps the order, so the vector stays sorted by id
+Snake * World::snakeById(int id) {
+    auto it = std::lower_bound(snakeMasterVec.begin(), snakeMasterVec.end(), id, [](const Snake &snake, int id) { return snake.id < id; });
+    if (it == snakeMasterVec.end() || it->id != id) return nullptr;
+    return &*it;
+}
+
+// scanOccupant() iterates through snakeMasterVec and through the PartStore slot of each Snake to find the first SnakePart
+// sitting in cell x, y. Only used for cells outside of occupancyGrid, so it leaves out the frozen Snakes: they are stuck on the board,
+// which is all inside the grid
+bool World::scanOccupant(int x, int y, int *ownerId, int *ownerColor) const {
+    for (auto snakeIt = snakeMasterVec.begin(); snakeIt != snakeMasterVec.end(); ++snakeIt) {
+        // a Snake removeSnake() took off the board has no slot to look in
+        if (snakeIt->slot < 0) continue;
+        int first = snakeIt->slot * partStore.capacity;
+        int last  = first + snakeIt->length;
+        for (int p = first; p < last; ++p) {
+            if (partStore.cellX[p] == x && partStore.cellY[p] == y) {
+                *ownerId = snakeIt->id;
+                *ownerColor = stateColor(partStore.state[p]);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// findOccupant() looks up cell x, y in occupancyGrid and returns the id and color of the Snake sitting in it.
+// It only reads the board, so the worker threads can all call it at once
+bool World::findOccupant(int x, int y, int *ownerId, int *ownerColor) const {
+    int index = occupancyGrid.cellIndex(x, y);
+    if (index < 0) {
+        return scanOccupant(x, y, ownerId, ownerColor);
+    }
+    Occupant occupant;
+    if (!occupancyGrid.lowestOccupant(index, &occupant)) {
+        return false;
+    }
+    *ownerId = occupant.snakeId;
+    *ownerColor = occupant.color;
+    return true;
+}
+
+// collisionCheck() checks if any SnakePart sits in cell x, y
+bool World::collisionCheck(int x, int y) const {
+    int ownerId;
+    int ownerColor;
+    return findOccupant(x, y, &ownerId, &ownerColor);
+}
+
+// This collisionCheck() checks the color of the asking snake against the snake sitting in cell x, y. if they match then that snake's id goes into intent.kills
+bool World::collisionCheck(int x, int y, SnakeRef self, MoveIntent &intent, bool * didSnakeDie) const {
+    int ownerId;
+    int ownerColor;
+    if (!findOccupant(x, y, &ownerId, &ownerColor)) {
+        return false;
+    }
+    if (ownerId == self.id) {
+        return true;
+    }
+    if (ownerColor == self.color) {
+        intent.kills[intent.killCount++] = ownerId;
+        *didSnakeDie = true;
+    }
+    return true;
+}
+
+// Calls either of the collisionCheck() functions and if there is a collision it will check around the head of the snake
+//to see if there are any open spaces and if there are the snake will change directions to keep moving until
+//no open spaces are available. It doesn't change the Snake or the board, the new direction and the kills go into intent
+
+// probeOccupied() answers collisionCheck(x, y) for the neighbour of the head in direction d from the neighbour bits.
+// Only a neighbour outside the grid still has to be looked up, and counts as one of intent's probes
+static bool probeOccupied(const World &world, uint8_t neighbors, int d, int x, int y, MoveIntent &intent) {
+    if (neighborSameColor(neighbors, d) && !neighborOccupied(neighbors, d)) {
+        ++intent.probes;
+        return world.collisionCheck(x, y);
+    }
+    return neighborOccupied(neighbors, d);
+}
+
+// probeColor() answers collisionCheck(x, y, self, intent, killed) for the neighbour in direction d. Without a SnakePart of the snake's own color
+// there the occupant can't be the snake itself or something it kills, so only those neighbours go to collisionCheck() to find out who it is
+static bool probeColor(const World &world, uint8_t neighbors, int d, int x, int y, SnakeRef self, MoveIntent &intent, bool *killed) {
+    if (!neighborSameColor(neighbors, d)) return neighborOccupied(neighbors, d);
+    ++intent.probes;
+    return world.collisionCheck(x, y, self, intent, killed);
+}
+
+bool Snake::collisionSnakeCheck(MoveIntent &intent) const {
+    return collisionSnakeCheck(intent, world->occupancyGrid.neighborMask(world->partStore.cellX[head()], world->partStore.cellY[head()], color));
+}
+
+// collisionSnakeCheck() decides where the Snake goes this tick from neighbors, its head's neighborMask() at the start of the tick
+bool Snake::collisionSnakeCheck(MoveIntent &intent, uint8_t neighbors) const {
+    const PartStore &partStore = world->partStore;
+    int boardCols = world->boardCols;
+    int boardRows = world->boardRows;
+    bool snakeKilled = false;
+    intent.direction = direction;
+    intent.wantsSouth = wantsSouth;
+    intent.stuck = false;
+    intent.killCount = 0;
+    intent.probes = 0;
+    SnakeRef self = ref();
+    int headX = partStore.cellX[head()];
+    int headY = partStore.cellY[head()];
+
+    int forward = intent.direction;
+    int checkX = headX + directionStepX[forward];
+    int checkY = headY + directionStepY[forward];
+
+    int checkEastX = headX + 1;
+    int checkEastY = headY;
+
+    int checkWestX = headX - 1;
+    int checkWestY = headY;
+
+    int checkSouthX = headX;
+    int checkSouthY = headY + 1;
+
+    //If there was a collision last tick, and it killed the snake so now there is no collision, move to the south OR if there was a collision last tick and there is another collision this tick and the snake dies then move to the south 
+    if ((intent.wantsSouth == true && !probeOccupied(*world, neighbors, SOUTH, checkSouthX, checkSouthY, intent) && checkY < boardRows - 1) || (intent.wantsSouth == true && probeColor(*world, neighbors, SOUTH, checkSouthX, checkSouthY, self, intent, &snakeKilled) && snakeKilled == true && checkY < boardRows - 1)) {
+        intent.direction = SOUTH;
+        intent.wantsSouth = false;
+    }
+
+    // Is there a collision?
+    if (probeColor(*world, neighbors, forward, checkX, checkY, self, intent, &snakeKilled) || checkX < 0 || checkX > boardCols - 1 || checkY > boardRows - 1) {
+        if (snakeKilled) {
+            return false;
+        } 
+            //Is there space to the South?
+            if (!probeOccupied(*world, neighbors, SOUTH, checkSouthX, checkSouthY, intent) && checkY < boardRows - 1) {
+                intent.direction = SOUTH;
+                //Is there space to the West?
+            } else if ((!probeOccupied(*world, neighbors, WEST, checkWestX, checkWestY, intent) && checkX > 0) || (probeColor(*world, neighbors, WEST, checkWestX, checkWestY, self, intent, &snakeKilled) && snakeKilled == true && checkX > 0)) {
+                intent.direction = WEST;
+                intent.wantsSouth = true;
+                //Is there space to the East?
+            } else if ((!probeOccupied(*world, neighbors, EAST, checkEastX, checkEastY, intent) && checkX < boardCols - 1) || (probeColor(*world, neighbors, EAST, checkEastX, checkEastY, self, intent, &snakeKilled) && snakeKilled == true && checkX < boardCols - 1)) {
+                intent.direction = EAST;
+                intent.wantsSouth = true;
+                //If there are no open spaces then return true; there is a full collision.
+            }else {
+                intent.stuck = true;
+                return true;
+            }
+    }
+    return false;
+}
+
+// resetSimulation() empties the board and starts over with a cols x rows board and the rng seeded with seed,
+// so the same seed and board always play out the same game
+void World::resetSimulation(unsigned int seed, int cols, int rows) {
+    boardCols = cols;
+    boardRows = rows;
+    spawnCheckX = spawnCheckColumn(boardCols);
+    startingXRange = std::uniform_real_distribution <double>(0, boardCols);
+    rng.seed(seed);
+
+    snakeID = 0;
+    addSnake = false;
+    tickNumber = 0;
+    // the Snakes give their cells back as they go, so they have to go before the board they sit on is reset
+    snakeMasterVec.clear();
+    frozenLayer.clear();
+    dirtyCells.clear();
+    std::memset(&stats, 0, sizeof(stats));
+    stats.filledTick = -1;
+    partStore.reset((int)lengthRange.max());
+    occupancyGrid.reset(boardCols, boardRows, 1, (int)lengthRange.max());
+}
+
+/******************************************
+*           WorkerPool class              *
+*******************************************/
+
+// parallelFor() chunks are this many Snakes
+int const WORK_CHUNK = 64;
+
+WorkerPool::WorkerPool() {
+    job = nullptr;
+    jobWorld = nullptr;
+    jobCount = 0;
+    nextIndex = 0;
+    busy = 0;
+    generation = 0;
+    quitting = false;
+}
+
+WorkerPool::~WorkerPool() {
+    stop();
+}
+
+// start() spawns workerCount threads, the thread calling parallelFor() always works along with them
+void WorkerPool::start(int workerCount) {
+    stop();
+    quitting = false;
+    for (int i = 0; i < workerCount; ++i) {
+        threads.push_back(std::thread(&WorkerPool::workerLoop, this));
+    }
+}
+
+void WorkerPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quitting = true;
+    }
+    wake.notify_all();
+    for (auto it = threads.begin(); it != threads.end(); ++it) {
+        it->join();
+    }
+    threads.clear();
+}
+
+void WorkerPool::parallelFor(World &world, int count, void (*jobFunc)(World &world, int begin, int end)) {
+    if (threads.empty() || count <= WORK_CHUNK) {
+        jobFunc(world, 0, count);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = jobFunc;
+        jobWorld = &world;
+        jobCount = count;
+        nextIndex = 0;
+        busy = (int)threads.size();
+        ++generation;
+    }
+    wake.notify_all();
+    runChunks();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return busy == 0; });
+}
+
+void WorkerPool::workerLoop() {
+    unsigned int seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [this, seen] { return quitting || generation != seen; });
+        if (quitting) return;
+        seen = generation;
+        lock.unlock();
+        runChunks();
+        lock.lock();
+        if (--busy == 0) done.notify_one();
+    }
+}
+
+void WorkerPool::runChunks() {
+    int begin;
+    while ((begin = nextIndex.fetch_add(WORK_CHUNK)) < jobCount) {
+        job(*jobWorld, begin, std::min(begin + WORK_CHUNK, jobCount));
+    }
+}
+
+// setTickThreads() sets how many threads plan a tick, 1 plans on the calling thread only
+void World::setTickThreads(int threadCount) {
+    tickWorkers.start(std::max(0, threadCount - 1));
+}
+
+/******************************************
+*           FrozenLayer class             *
+*******************************************/
+
+FrozenLayer::FrozenLayer() {
+    world = nullptr;
+}
+
+// clear() drops every frozen Snake along with its cells, resetSimulation() calls it before the board is reset
+void FrozenLayer::clear() {
+    frozen.clear();
+    freezing.clear();
+    woken.clear();
+    dying.clear();
+    changedCells.clear();
+}
+
+// canFreeze() is whether snake will be stuck in the same way next tick as well: it settled for FREEZE_TICKS ticks in a row, and none of
+// the cells next to its head changed during this one. Heads next to a cell outside of occupancyGrid never settle, nobody watches those,
+// and neither do heads next to a cell that already has MAX_WATCHERS watchers
+static bool canFreeze(const World &world, const Snake &snake) {
+    if (snake.slot < 0 || snake.dieNextTick || snake.stuckTicks < FREEZE_TICKS) return false;
+    int head = snake.head();
+    for (int d = NORTH; d <= WEST; ++d) {
+        int index = world.occupancyGrid.cellIndex(world.partStore.cellX[head] + directionStepX[d], world.partStore.cellY[head] + directionStepY[d]);
+        if (index < 0 || world.occupancyGrid.changedTick[index] == world.tickNumber || world.occupancyGrid.watchers[index] >= MAX_WATCHERS) return false;
+    }
+    return true;
+}
+
+static bool idLess(const Snake &a, const Snake &b) { return a.id < b.id; }
+
+// find() returns the frozen Snake id, or nullptr if it isn't frozen
+Snake * FrozenLayer::find(int id) {
+    auto it = std::lower_bound(frozen.begin(), frozen.end(), id, [](const Snake &snake, int id) { return snake.id < id; });
+    return it != frozen.end() && it->id == id ? &*it : nullptr;
+}
+
+// freezeSettled() moves every Snake that canFreeze() into frozen at the end of a tick, sliding the rest of snakeMasterVec down the way killSnakes() does.
+// They come out of snakeMasterVec in id order, so one merge puts them into place among the Snakes frozen before
+void FrozenLayer::freezeSettled() {
+    std::vector<Snake> &snakeMasterVec = world->snakeMasterVec;
+    size_t kept = 0;
+    for (size_t i = 0; i < snakeMasterVec.size(); ++i) {
+        Snake &snake = snakeMasterVec[i];
+        if (canFreeze(*world, snake)) {
+            watch(snake, true);
+            noteCells(snake);
+            freezing.push_back(std::move(snake));
+        } else {
+            if (kept != i) snakeMasterVec[kept] = std::move(snake);
+            ++kept;
+        }
+    }
+    snakeMasterVec.erase(snakeMasterVec.begin() + kept, snakeMasterVec.end());
+    if (freezing.empty()) return;
+
+    merged.clear();
+    merged.reserve(frozen.size() + freezing.size());
+    std::merge(std::make_move_iterator(frozen.begin()), std::make_move_iterator(frozen.end()),
+               std::make_move_iterator(freezing.begin()), std::make_move_iterator(freezing.end()), std::back_inserter(merged), idLess);
+    frozen.swap(merged);
+    merged.clear();
+    freezing.clear();
+}
+
+// thawWoken() moves the woken Snakes back into snakeMasterVec, merging them in by id so it stays sorted, and slides the Snakes still frozen down over their places
+void FrozenLayer::thawWoken() {
+    if (woken.empty()) return;
+    std::sort(woken.begin(), woken.end());
+    woken.erase(std::unique(woken.begin(), woken.end()), woken.end());
+    std::vector<Snake> &snakeMasterVec = world->snakeMasterVec;
+    merged.clear();
+    merged.reserve(snakeMasterVec.size() + woken.size());
+    auto active = snakeMasterVec.begin();
+    auto id = woken.begin();
+    size_t kept = 0;
+    for (size_t i = 0; i < frozen.size(); ++i) {
+        Snake &snake = frozen[i];
+        for (; id != woken.end() && *id < snake.id; ++id) {}
+        if (id == woken.end() || *id != snake.id) {
+            if (kept != i) frozen[kept] = std::move(snake);
+            ++kept;
+            continue;
+        }
+        watch(snake, false);
+        noteCells(snake);
+        snake.stuckTicks = 0;
+        for (; active != snakeMasterVec.end() && active->id < snake.id; ++active) {
+            merged.push_back(std::move(*active));
+        }
+        merged.push_back(std::move(snake));
+    }
+    frozen.erase(frozen.begin() + kept, frozen.end());
+    for (; active != snakeMasterVec.end(); ++active) {
+        merged.push_back(std::move(*active));
+    }
+    snakeMasterVec.swap(merged);
+    merged.clear();
+    woken.clear();
+}
+
+// thaw() thaws the frozen Snake id right away, along with any other woken ones, and returns it in snakeMasterVec
+Snake * FrozenLayer::thaw(int id) {
+    woken.push_back(id);
+    thawWoken();
+    return world->snakeById(id);
+}
+
+// kill() marks the frozen Snake id dead, returns false if there is no such Snake or it is dying already
+bool FrozenLayer::kill(int id) {
+    Snake *snake = find(id);
+    if (snake == nullptr || snake->dieNextTick) return false;
+    snake->dieNextTick = true;
+    dying.push_back(id);
+    return true;
+}
+
+// killDying() takes the frozen Snakes kill() marked off the board, waking any frozen heads next to them, and then slides the survivors down over them
+void FrozenLayer::killDying() {
+    if (dying.empty()) return;
+    for (auto id = dying.begin(); id != dying.end(); ++id) {
+        Snake *snake = find(*id);
+        if (snake == nullptr || snake->slot < 0) continue;
+        watch(*snake, false);
+        noteCells(*snake);
+        snake->vacateBoard();
+        PROFILE_COUNT(COUNTER_KILLS, 1);
+        ++world->stats.kills[snake->color];
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < frozen.size(); ++i) {
+        if (frozen[i].slot < 0) continue;
+        if (kept != i) frozen[kept] = std::move(frozen[i]);
+        ++kept;
+    }
+    frozen.erase(frozen.begin() + kept, frozen.end());
+    dying.clear();
+}
+
+// cellChanged() is called by occupancyGrid for a cell with watchers, and wakes every frozen Snake whose head is next to it
+void FrozenLayer::cellChanged(int index) {
+    const OccupancyGrid &occupancyGrid = world->occupancyGrid;
+    const int *ids = &occupancyGrid.watcherIds[index * MAX_WATCHERS];
+    for (int i = 0; i < occupancyGrid.watchers[index]; ++i) {
+        woken.push_back(ids[i]);
+    }
+}
+
+// watch() starts or stops snake's head watching its four neighbour cells
+void FrozenLayer::watch(const Snake &snake, bool watching) {
+    OccupancyGrid &occupancyGrid = world->occupancyGrid;
+    const PartStore &partStore = world->partStore;
+    int head = snake.head();
+    for (int d = NORTH; d <= WEST; ++d) {
+        int index = occupancyGrid.cellIndex(partStore.cellX[head] + directionStepX[d], partStore.cellY[head] + directionStepY[d]);
+        int *ids = &occupancyGrid.watcherIds[index * MAX_WATCHERS];
+        if (watching) {
+            ids[occupancyGrid.watchers[index]++] = snake.id;
+            continue;
+        }
+        //the last watcher takes the place of the one that stops, so the taken places stay packed at the front
+        int last = --occupancyGrid.watchers[index];
+        for (int i = 0; i < last; ++i) {
+            if (ids[i] == snake.id) {
+                ids[i] = ids[last];
+                break;
+            }
+        }
+    }
+}
+
+// noteCells() adds snake's cells to changedCells, for a Snake joining or leaving the layer
+void FrozenLayer::noteCells(const Snake &snake) {
+    const PartStore &partStore = world->partStore;
+    if (!world->trackDirtyCells) return;
+    for (int i = 0; i < snake.length; ++i) {
+        int p = snake.part(i);
+        CellRef cell = { partStore.cellX[p], partStore.cellY[p] };
+        changedCells.push_back(cell);
+    }
+}
+
+/******************************************
+*               game tick                 *
+*******************************************/
+
+// probeNeighbors() reads the neighbour bits of the heads of the Snakes in [begin, end) in one pass over the planes at the start of the tick,
+// so planMoves() decides from those bits and only touches the cells for the few probes that need an occupant's id
+static void probeNeighbors(World &world, int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+        const Snake &snake = world.snakeMasterVec[i];
+        if (snake.slot < 0) continue;
+        int head = snake.head();
+        world.neighborMasks[i] = world.occupancyGrid.neighborMask(world.partStore.cellX[head], world.partStore.cellY[head], snake.color);
+    }
+}
+
+// planMoves() is the parallel half of a tick: every Snake in [begin, end) works out its MoveIntent from the board as it was at the start of the tick.
+// Nothing gets written but moveIntents, so the outcome doesn't depend on how the Snakes are split between threads
+static void planMoves(World &world, int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+        const Snake &snake = world.snakeMasterVec[i];
+        MoveIntent &intent = world.moveIntents[i];
+        if (snake.slot < 0) {
+            // removed by removeSnake() since the last tick, it sits this one out
+            intent.direction = snake.direction;
+            intent.wantsSouth = snake.wantsSouth;
+            intent.stuck = false;
+            intent.killCount = 0;
+            intent.probes = 0;
+            continue;
+        }
+        snake.collisionSnakeCheck(intent, world.neighborMasks[i]);
+    }
+}
+
+// resolveMoves() is the serial half of a tick. All the kills are applied first and the dead Snakes stay where they are,
+// then the rest move in snakeMasterVec order. When two Snakes head for the same cell the earlier one gets it and the later one waits a tick
+void World::resolveMoves() {
+    int count = (int)snakeMasterVec.size();
+    for (int i = 0; i < count; ++i) {
+        for (int k = 0; k < moveIntents[i].killCount; ++k) {
+            Snake *victim = snakeById(moveIntents[i].kills[k]);
+            if (victim != nullptr) {
+                victim->dieNextTick = true;
+            } else {
+                frozenLayer.kill(moveIntents[i].kills[k]);
+            }
+        }
+    }
+    for (int i = 0; i < count; ++i) {
+        Snake &snake = snakeMasterVec[i];
+        MoveIntent &intent = moveIntents[i];
+        bool settled = intent.stuck && intent.killCount == 0 && intent.direction == snake.direction && intent.wantsSouth == snake.wantsSouth;
+        snake.stuckTicks = settled ? snake.stuckTicks + 1 : 0;
+        snake.direction = intent.direction;
+        snake.wantsSouth = intent.wantsSouth;
+        addSnake = intent.stuck;
+        if (intent.stuck || snake.dieNextTick) continue;
+
+        int x = partStore.cellX[snake.head()] + directionStepX[snake.direction];
+        int y = partStore.cellY[snake.head()] + directionStepY[snake.direction];
+        if (occupancyGrid.claim(x, y, tickNumber)) {
+            snake.move();
+        }
+    }
+    // a frozen Snake is stuck every tick, so when the newest Snake is frozen the tick ends on addSnake just as if it had been resolved last
+    if (!frozenLayer.frozen.empty() && (count == 0 || frozenLayer.frozen.back().id > snakeMasterVec[count - 1].id)) {
+        addSnake = true;
+    }
+}
+
+// gameTick() runs one GAME_TICK: the frozen Snakes that were woken are thawed, every Snake plans its move on the tickWorkers,
+// the moves and kills are resolved, the dead Snakes get removed and if the last Snake got stuck a new one spawns, as long as the spawn cell is free.
+// Last the Snakes that settled are frozen
+void World::gameTick() {
+    ++tickNumber;
+    PROFILE_BEGIN_TICK(tickNumber);
+    {
+        PROFILE_SCOPE(PHASE_TICK);
+        frozenLayer.thawWoken();
+        {
+            PROFILE_SCOPE(PHASE_PLAN);
+            moveIntents.resize(snakeMasterVec.size());
+            neighborMasks.resize(snakeMasterVec.size());
+            tickWorkers.parallelFor(*this, (int)snakeMasterVec.size(), probeNeighbors);
+            tickWorkers.parallelFor(*this, (int)snakeMasterVec.size(), planMoves);
+#ifdef SNAKES_PROFILE
+            // the planners count their probes in their own MoveIntents, they go to the profiler in one add instead of one per probe
+            long long probes = 0;
+            for (auto it = moveIntents.begin(); it != moveIntents.end(); ++it) probes += it->probes;
+            PROFILE_COUNT(COUNTER_PROBES, probes);
+#endif
+        }
+        {
+            PROFILE_SCOPE(PHASE_RESOLVE);
+            resolveMoves();
+        }
+        {
+            PROFILE_SCOPE(PHASE_KILL);
+            killSnakes();
+        }
+        if (addSnake) {
+            PROFILE_SCOPE(PHASE_SPAWN);
+            PROFILE_COUNT(COUNTER_PROBES, 1);
+            if (!collisionCheck(spawnCheckX, spawnCheckY)) {
+                snakeMasterVec.emplace_back(*this);
+            } else if (stats.filledTick < 0) {
+                stats.filledTick = tickNumber;
+            }
+        }
+        frozenLayer.freezeSettled();
+        if (occupancyGrid.filledCells > stats.peakCells) {
+            stats.peakCells = occupancyGrid.filledCells;
+            stats.peakTick = tickNumber;
+        }
+    }
+    PROFILE_END_TICK();
+}
+
+// simulationHash() folds every Snake and every SnakePart, head to tail, into a 64 bit FNV-1a hash.
+// Two runs with the same seed and board have to end on the same hash, frozen Snakes or not
+uint64_t World::simulationHash() const {
+    uint64_t hash = 14695981039346656037ULL;
+    auto fold = [&hash](int64_t value) {
+        for (int i = 0; i < 8; ++i) {
+            hash ^= (uint64_t)(value >> (i * 8)) & 0xff;
+            hash *= 1099511628211ULL;
+        }
+    };
+    fold(snakeID);
+    fold(addSnake);
+    forEachSnake([this, &fold](const Snake &snake) {
+        fold(snake.id);
+        fold(snake.length);
+        fold(snake.direction);
+        fold(snake.color);
+        fold(snake.wantsSouth);
+        fold(snake.dieNextTick);
+        // a Snake removeSnake() took off the board has no parts left to fold
+        for (int i = 0; snake.slot >= 0 && i < snake.length; ++i) {
+            int p = snake.part(i);
+            fold(partStore.cellX[p]);
+            fold(partStore.cellY[p]);
+            fold(partStore.state[p]);
+        }
+    });
+    return hash;
+}
+
+// runHeadless() plays ticks game ticks on a cols x rows board as fast as it can, without a window, renderer or textures,
+// then prints the ticks per second and the final simulationHash(). The hash is the same for any threadCount
+void runHeadless(unsigned int seed, int cols, int rows, int ticks, int threadCount) {
+    World world;
+    world.setTickThreads(threadCount);
+    world.resetSimulation(seed, cols, rows);
+    world.snakeMasterVec.push_back(Snake(world));
+
+    auto start = std::chrono::steady_clock::now();
+    for (int tick = 0; tick < ticks; ++tick) {
+        world.gameTick();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << "seed " << seed << ", board " << cols << "x" << rows << ", " << ticks << " ticks, " << threadCount << " threads" << std::endl;
+    world.printRunSummary(ticks, elapsed.count());
+}
+
+// printRunSummary() prints how many snakes are left, how fast the ticks ran and the simulationHash() at the end of a headless run
+void World::printRunSummary(int ticks, double seconds) const {
+    std::cout << "snakes alive: " << snakeCount() << " (" << frozenLayer.frozen.size() << " frozen), snakes spawned: " << snakeID << std::endl;
+    std::cout << "ticks/sec: " << (seconds > 0 ? ticks / seconds : 0) << std::endl;
+    std::cout << "state hash: " << std::hex << simulationHash() << std::dec << std::endl;
+}
@@ -0,0 +1,420 @@
+#pragma once
+// snakeSim.h is the simulation half of Savage Snakes: the board, the snakes and the game tick, all of it kept in a World.
+// Nothing in here touches SDL, so it runs the same with a window or headless
+#include <vector>
+#include <random>
+#include <cstdint>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+enum directions { NORTH, EAST, SOUTH, WEST, TOP_RIGHT_CORNER, TOP_LEFT_CORNER, BOTTEM_RIGHT_CORNER, BOTTEM_LEFT_CORNER };
+enum snakeColors { GREEN, BLUE, RED };
+int const SNAKE_COLOR_COUNT = 3;
+
+//a SnakePart that is not bent has no corner
+constexpr int NO_CORNER = 0;
+
+struct World;
+
+//a cell of the board, World::dirtyCells and FrozenLayer::changedCells are lists of them
+struct CellRef {
+    int16_t x;
+    int16_t y;
+};
+
+//the cells from x, y up to but not including x + w, y + h
+struct CellRect {
+    int x;
+    int y;
+    int w;
+    int h;
+};
+
+/******************************************
+*            PartStore class              *
+*                                         *
+*  the simulation state of every          *
+*  SnakePart, one packed array per field  *
+*******************************************/
+
+// Every Snake owns one slot of capacity parts in the store, its SnakeParts live at slot * capacity + ring index.
+// Cells are int16 board coordinates and each part's direction, corner and color are packed into one byte,
+// so the tick loops only ever touch 5 bytes per part. Freed slots are handed out again to the next Snake
+struct PartStore {
+    void reset(int partsPerSnake);
+    int  allocSlot();
+    void freeSlot(int slot);
+
+    int                  capacity;
+    std::vector<int16_t> cellX;
+    std::vector<int16_t> cellY;
+    std::vector<uint8_t> state;
+    std::vector<int>     freeSlots;
+};
+
+// state byte layout: bits 0-1 direction, bits 2-4 corner, bits 5-6 color
+inline uint8_t packState(int direction, int corner, int color) { return (uint8_t)(direction | corner << 2 | color << 5); }
+inline int stateDirection(uint8_t state) { return state & 0x03; }
+inline int stateCorner(uint8_t state)    { return (state >> 2) & 0x07; }
+inline int stateColor(uint8_t state)     { return (state >> 5) & 0x03; }
+
+// how far one step in each direction moves a cell
+extern int const directionStepX[];
+extern int const directionStepY[];
+
+/******************************************
+*          OccupancyGrid class            *
+*                                         *
+*  who sits in each cell of the board     *
+*******************************************/
+
+struct Occupant {
+    int snakeId;
+    int color;
+};
+
+// The grid is stored in CHUNK_SIZE x CHUNK_SIZE chunks, each chunk's cells next to each other in cells, and chunkParts counts
+// the SnakeParts in every chunk so the renderer can skip the empty ones.
+// Besides the cells there is one bit per cell in a plane per snakeColors and in an ANY_PLANE, set while a SnakePart of that color
+// (or any SnakePart) sits in the cell. A row of each plane is wordsPerRow 64 bit words and the four planes of a row sit next to each other.
+// Every cell keeps its first two occupants inline, the rare cell that stacks up more keeps the rest in overflow.
+// A cell can hold more than one SnakePart when a snake moves onto a snake it just killed, or with the off screen tails
+// of freshly spawned snakes. The Snake with the lowest id counts as the occupant, which is the first one in snakeMasterVec
+struct GridCell {
+    int      count;
+    Occupant occupants[2];
+};
+
+int const CHUNK_SHIFT = 4;
+int const CHUNK_SIZE  = 1 << CHUNK_SHIFT;
+int const CHUNK_CELLS = CHUNK_SIZE * CHUNK_SIZE;
+
+//planes 0 to 2 are the snakeColors
+int const ANY_PLANE   = 3;
+int const PLANE_COUNT = 4;
+
+// neighborMask() bits: bit d is set when the neighbour in direction d is occupied, bit 4 + d when a SnakePart of the asking snake's color is there.
+// A neighbour outside the grid sets only bit 4 + d, which no cell inside it can, so the probe knows to ask findOccupant()
+inline bool neighborOccupied(uint8_t mask, int d)  { return ((mask >> d) & 1) != 0; }
+inline bool neighborSameColor(uint8_t mask, int d) { return ((mask >> (4 + d)) & 1) != 0; }
+
+//a cell has four neighbours, so it has room for the heads of four frozen Snakes to watch it
+int const MAX_WATCHERS = 4;
+
+struct OccupancyGrid {
+    void reset(int boardCols, int boardRows, int marginCols, int marginTopRows);
+    int  cellIndex(int x, int y) const;
+    int  chunkIndex(int chunkX, int chunkY) const;
+    int  chunkOriginX(int chunkX) const { return originX + (chunkX << CHUNK_SHIFT); }
+    int  chunkOriginY(int chunkY) const { return originY + (chunkY << CHUNK_SHIFT); }
+    int  chunkOfX(int x) const          { return (x - originX) >> CHUNK_SHIFT; }
+    int  chunkOfY(int y) const          { return (y - originY) >> CHUNK_SHIFT; }
+    bool onBoard(int x, int y) const    { return x >= 0 && x < cols + 2 * originX && y >= 0 && y < rows + originY - 1; }
+    void occupy(int x, int y, int id, int color);
+    void vacate(int x, int y, int id);
+    void touched(int index);
+    bool lowestOccupant(int index, Occupant *found) const;
+    int  occupantsAt(int x, int y, Occupant *found, int maxCount) const;
+    bool claim(int x, int y, int tick);
+    uint8_t neighborMask(int x, int y, int color) const;
+    uint64_t & planeWord(int plane, int gridX, int gridY) { return planes[(gridY * PLANE_COUNT + plane) * wordsPerRow + (gridX >> 6)]; }
+    bool planeBit(int plane, int gridX, int gridY) const  { return (planes[(gridY * PLANE_COUNT + plane) * wordsPerRow + (gridX >> 6)] >> (gridX & 63)) & 1; }
+
+    int                                    originX;
+    int                                    originY;
+    int                                    cols;
+    int                                    rows;
+    int                                    chunkCols;
+    int                                    chunkRows;
+    std::vector<GridCell>                  cells;
+    std::vector<int>                       chunkParts;
+    //how many cells of the board itself, the margin left out, have at least one SnakePart in them
+    int                                    filledCells;
+    int                                    wordsPerRow;
+    std::vector<uint64_t>                  planes;
+    std::unordered_multimap<int, Occupant> overflow;
+    //the last tick a Snake claimed each cell to move into
+    std::vector<int>                       claimedTick;
+    //the tickNumber during or after which a SnakePart last came into or left each cell
+    std::vector<int>                       changedTick;
+    //how many frozen heads sit next to each cell, see FrozenLayer
+    std::vector<uint16_t>                  watchers;
+    //the ids of those heads, MAX_WATCHERS places per cell of which the first watchers[index] are taken
+    std::vector<int>                       watcherIds;
+    //the World the grid is the board of, touched() stamps its tickNumber and wakes its frozenLayer
+    World                                 *world;
+};
+
+// MoveIntent is what a Snake decided to do this tick, worked out from the board as it was at the start of the tick
+struct MoveIntent {
+    int  direction;
+    bool wantsSouth;
+    //collisionSnakeCheck() found no open space, the Snake doesn't move
+    bool stuck;
+    //ids of the same colored Snakes this one ran into, they die at the end of the tick
+    int  killCount;
+    int  kills[4];
+    //how many cells collisionSnakeCheck() had to look up in occupancyGrid because the neighbour bits couldn't answer
+    int  probes;
+};
+
+// SnakeRef is all a collision query needs to know about the Snake asking: who it is and which color it kills
+struct SnakeRef {
+    int id;
+    int color;
+};
+
+/******************************************
+*               Snake class               *
+*                                         *
+*  an object owning a slot of SnakeParts  *
+*  in the PartStore, used as a ring       *
+*  buffer with headIndex as the head      *
+*******************************************/
+
+// A Snake owns its slot and its cells in its World's occupancyGrid and gives both back when it is destroyed, so it can be moved but not copied.
+// A moved from Snake has no slot (-1) and owns nothing
+struct Snake {
+    World                 *world;
+    int                    id;
+    int                    length;
+    int                    headIndex;
+    int                    slot;
+    int                    direction;
+    int                    color;
+    bool                   wantsSouth;
+    bool                   dieNextTick;
+    //how many ticks in a row the Snake has been stuck without its direction or wantsSouth changing
+    int                    stuckTicks;
+
+    // a new Snake with the next snakeID and a length and color from world's rng, its head on the top row of the board
+    explicit Snake(World &world);
+    // a Snake with a slot for its parts but nowhere on the board yet, for loading a saved game. Draws nothing from rng
+    Snake(World &world, int id, int length, int color);
+    Snake(Snake &&other);
+    Snake & operator=(Snake &&other);
+    ~Snake();
+    // copying a Snake would give its slot two owners
+    Snake(const Snake &) = delete;
+    Snake & operator=(const Snake &) = delete;
+
+    // part() returns the PartStore index of the SnakePart that is i parts behind the head
+    int part(int i) const;
+    int head() const;
+    SnakeRef ref() const  { SnakeRef r = { id, color }; return r; }
+
+    void createSnakeParts(int length, int color);
+    void arrangeSnakeParts();
+    void orient();
+    void move();
+    void vacateBoard();
+    bool collisionSnakeCheck(MoveIntent &intent) const;
+    bool collisionSnakeCheck(MoveIntent &intent, uint8_t neighbors) const;
+};
+
+// cornerTable[front][back] is the corner a SnakePart facing back needs when the SnakePart in front of it faces front,
+// so if snakepart2 is facing south and snakepart1 is facing east, snakepart2 gets a BOTTEM_LEFT_CORNER
+constexpr int cornerTable[4][4] = {
+    /* front NORTH */ { NO_CORNER,           TOP_LEFT_CORNER,    NO_CORNER,        TOP_RIGHT_CORNER    },
+    /* front EAST  */ { BOTTEM_RIGHT_CORNER, NO_CORNER,          TOP_RIGHT_CORNER, NO_CORNER           },
+    /* front SOUTH */ { NO_CORNER,           BOTTEM_LEFT_CORNER, NO_CORNER,        BOTTEM_RIGHT_CORNER },
+    /* front WEST  */ { BOTTEM_LEFT_CORNER,  NO_CORNER,          TOP_LEFT_CORNER,  NO_CORNER           },
+};
+
+inline int cornerBetween(int frontDirection, int backDirection) { return cornerTable[frontDirection][backDirection]; }
+void removeSnake(Snake &snake);
+
+/******************************************
+*           FrozenLayer class             *
+*                                         *
+*  the Snakes that are stuck for good,    *
+*  which no tick has to look at           *
+*******************************************/
+
+// A Snake that is stuck decides the same MoveIntent again every tick for as long as its direction, its wantsSouth and the four
+// cells next to its head stay the same. Once it has been stuck like that for FREEZE_TICKS ticks and nothing next to its head changed
+// during the last one, freezeSettled() moves it out of its World's snakeMasterVec into frozen. Its parts stay in occupancyGrid, so to the Snakes
+// still moving it is just part of the board, but no tick probes, plans, resolves or draws it part by part any more.
+// A frozen head watches its four neighbour cells: occupancyGrid.watchers counts the heads watching each cell and watcherIds says whose
+// they are, and any occupy() or vacate() of a watched cell puts the watching Snakes on woken. The next tick thaws them back into
+// snakeMasterVec before anything plans, so the game plays out exactly as if they had never been frozen. A head that would be a cell's
+// fifth watcher isn't frozen. A frozen Snake can still be killed, it goes on dying until killSnakes() takes it off the board.
+// changedCells collects the cells of the Snakes that join or leave the layer for the front end while trackDirtyCells is set.
+// frozen is sorted by id like snakeMasterVec and Snakes are merged into and compacted out of it the same way, so once the vectors have grown
+// freezing and thawing allocate nothing
+int const FREEZE_TICKS = 3;
+
+struct FrozenLayer {
+    FrozenLayer();
+    void clear();
+    Snake * find(int id);
+    void freezeSettled();
+    void thawWoken();
+    Snake * thaw(int id);
+    bool kill(int id);
+    void killDying();
+    void cellChanged(int index);
+    void watch(const Snake &snake, bool watching);
+    void noteCells(const Snake &snake);
+
+    std::vector<int>                  woken;
+    std::vector<int>                  dying;
+    std::vector<CellRef>              changedCells;
+    //thawWoken() merges into it and swaps it with snakeMasterVec, it keeps its memory between thaws
+    std::vector<Snake>                merged;
+    //freezeSettled() gathers the Snakes it freezes here before merging them into frozen
+    std::vector<Snake>                freezing;
+    World                            *world;
+    //declared last so it goes first: a frozen Snake gives its cells back through occupancyGrid, which calls cellChanged()
+    std::vector<Snake>                frozen;
+};
+
+/******************************************
+*           WorkerPool class              *
+*                                         *
+*  threads that share the planning half   *
+*  of every tick                          *
+*******************************************/
+
+// parallelFor() hands out [0, count) of world in chunks to the worker threads and the calling thread and returns once all of it is done.
+// With no worker threads it just runs the job on the calling thread
+struct WorkerPool {
+    WorkerPool();
+    ~WorkerPool();
+    void start(int workerCount);
+    void stop();
+    void parallelFor(World &world, int count, void (*job)(World &world, int begin, int end));
+    void workerLoop();
+    void runChunks();
+
+    std::vector<std::thread> threads;
+    std::mutex               mutex;
+    std::condition_variable  wake;
+    std::condition_variable  done;
+    void                   (*job)(World &world, int begin, int end);
+    World                   *jobWorld;
+    int                      jobCount;
+    std::atomic<int>         nextIndex;
+    int                      busy;
+    unsigned int             generation;
+    bool                     quitting;
+};
+
+// the player's inputs, the only way the game changes the simulation between ticks. The game logs each one with the
+// tickNumber it came after, so applying them at the same ticks again replays the run
+enum inputActions { INPUT_REMOVE_OLDEST, INPUT_STEER_WEST, INPUT_STEER_SOUTH, INPUT_STEER_EAST, INPUT_SPAWN, INPUT_ACTION_COUNT };
+
+/******************************************
+*              World class                *
+*                                         *
+*  one board and everything on it         *
+*******************************************/
+
+// what happened in a World since resetSimulation(), kept whether or not the profiler is built in.
+// filledTick is the first tick a new Snake was due and its spawn cell was taken, the board has filled up to the top there. -1 until then.
+// Kills keep the bigger boards from ever getting that far, peakCells is the most cells that were filled at the end of a tick and peakTick the first tick it got there
+struct WorldStats {
+    long long kills[SNAKE_COLOR_COUNT];
+    long long spawns;
+    int       filledTick;
+    int       peakCells;
+    int       peakTick;
+};
+
+// spawnCheckColumn() is the column of the top row a new Snake waits for, 8 of the 20 columns of the window board and as far across any other
+inline int spawnCheckColumn(int cols) { return cols * 2 / 5; }
+
+// A World is one whole game: the board, its Snakes, its rng and the workers that plan its ticks. Nothing in the simulation is shared
+// between Worlds, so any number of them can tick on different threads at once and each plays out as it would alone.
+// Its Snakes, grid and frozen layer point back at it, so a World is neither copied nor moved
+struct World {
+    World();
+    ~World();
+    // the Snakes would still point at the World they were copied from
+    World(const World &) = delete;
+    World & operator=(const World &) = delete;
+
+    void markDirty(int x, int y);
+    void killSnakes();
+    Snake * snakeById(int id);
+    bool scanOccupant(int x, int y, int *ownerId, int *ownerColor) const;
+    bool findOccupant(int x, int y, int *ownerId, int *ownerColor) const;
+    bool collisionCheck(int x, int y) const;
+    bool collisionCheck(int x, int y, SnakeRef self, MoveIntent &intent, bool * didSnakeDie) const;
+    void applyInput(int action);
+    void setTickThreads(int threadCount);
+    void resetSimulation(unsigned int seed, int cols, int rows);
+    void resolveMoves();
+    void gameTick();
+    uint64_t simulationHash() const;
+    void printRunSummary(int ticks, double seconds) const;
+    template <typename Visit>
+    void forEachSnake(Visit visit) const;
+    // snakeCount() is how many Snakes there are, frozen or not
+    int  snakeCount() const { return (int)(snakeMasterVec.size() + frozenLayer.frozen.size()); }
+
+    int snakeID;
+
+    //the board is counted in cells, the window draws each cell SNAKEPART_SIZE pixels wide
+    int boardCols;
+    int boardRows;
+
+    //a new snake only spawns when this cell on the top row is free, resetSimulation() puts it at spawnCheckColumn()
+    int spawnCheckX;
+    int spawnCheckY;
+
+    //set when the last Snake of a tick got stuck, a new Snake spawns at the end of the tick
+    bool addSnake;
+
+    //counts the ticks since resetSimulation()
+    int tickNumber;
+
+    //cells whose drawing changed since the front end last took them: spawns, moves and removed snakes mark them.
+    //They are only collected while trackDirtyCells is set and only inside dirtyRegion.
+    //FrameSnapshot::build() takes them and clears dirtyCells
+    bool                 trackDirtyCells;
+    CellRect             dirtyRegion;
+    std::vector<CellRef> dirtyCells;
+
+    //These are the number ranges that use the rng, used for the spawning x position of the snake, the length of the snake, and the color of the snake
+    std::uniform_real_distribution <double> startingXRange;
+    std::uniform_real_distribution <double> lengthRange;
+    std::uniform_real_distribution <double> colorRange;
+    std::minstd_rand0 rng;
+
+    WorldStats    stats;
+    PartStore     partStore;
+    OccupancyGrid occupancyGrid;
+    WorkerPool    tickWorkers;
+
+    //one MoveIntent per Snake in snakeMasterVec, filled by planMoves()
+    std::vector<MoveIntent> moveIntents;
+    //the neighborMask() of every Snake's head, filled by probeNeighbors() before planMoves() runs
+    std::vector<uint8_t>    neighborMasks;
+
+    //the Snakes go before the board they sit on, the destructor clears them first
+    FrozenLayer        frozenLayer;
+    std::vector<Snake> snakeMasterVec;
+};
+
+inline int Snake::part(int i) const { return slot * world->partStore.capacity + (headIndex + i) % length; }
+inline int Snake::head() const      { return slot * world->partStore.capacity + headIndex; }
+
+// forEachSnake() calls visit on every Snake in id order, the ones in snakeMasterVec and the frozen ones alike
+template <typename Visit>
+void World::forEachSnake(Visit visit) const {
+    auto active = snakeMasterVec.begin();
+    auto frozen = frozenLayer.frozen.begin();
+    while (active != snakeMasterVec.end() || frozen != frozenLayer.frozen.end()) {
+        if (frozen == frozenLayer.frozen.end() || (active != snakeMasterVec.end() && active->id < frozen->id)) {
+            visit(*active++);
+        } else {
+            visit(*frozen++);
+        }
+    }
+}
+
+void runHeadless(unsigned int seed, int cols, int rows, int ticks, int threadCount);
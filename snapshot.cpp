@@ -0,0 +1,313 @@
+#include "snapshot.h"
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/******************************************
+*           MappedFile class              *
+*******************************************/
+
+MappedFile::MappedFile() {
+    data = nullptr;
+    size = 0;
+#ifdef _WIN32
+    file = INVALID_HANDLE_VALUE;
+    mapping = nullptr;
+#else
+    fd = -1;
+#endif
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+// open() maps all of path read only, an empty file opens with no data
+bool MappedFile::open(const std::string &path) {
+    close();
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        close();
+        return false;
+    }
+    size = (size_t)fileSize.QuadPart;
+    if (size == 0) return true;
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == nullptr) {
+        close();
+        return false;
+    }
+    data = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close();
+        return false;
+    }
+    size = (size_t)info.st_size;
+    if (size == 0) return true;
+    void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    data = mapped == MAP_FAILED ? nullptr : (const unsigned char *)mapped;
+#endif
+    if (data == nullptr) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+    if (data != nullptr) UnmapViewOfFile(data);
+    if (mapping != nullptr) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    mapping = nullptr;
+    file = INVALID_HANDLE_VALUE;
+#else
+    if (data != nullptr) munmap((void *)data, size);
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+#endif
+    data = nullptr;
+    size = 0;
+}
+
+/******************************************
+*               snapshots                 *
+*******************************************/
+
+// saveSnapshot() writes everything world's next gameTick() depends on: the board, every Snake and SnakePart, snakeID, tickNumber,
+// addSnake and the rng. minstd_rand0 only hands out its state as text, so it goes through a stringstream.
+// Frozen Snakes are saved like any other and come back active, they freeze again once they have settled.
+// inputCount is how many inputs the run has logged so far, the ones already in world
+bool saveSnapshot(const World &world, const std::string &path, uint32_t inputCount) {
+    const PartStore &partStore = world.partStore;
+    std::vector<SnapshotSnake> snakes;
+    std::vector<SnapshotPart>  parts;
+    snakes.reserve(world.snakeCount());
+    world.forEachSnake([&snakes, &parts, &partStore](const Snake &saved) {
+        SnapshotSnake snake;
+        std::memset(&snake, 0, sizeof(snake));
+        snake.id = saved.id;
+        snake.length = saved.length;
+        snake.direction = saved.direction;
+        snake.color = saved.color;
+        snake.firstPart = (int32_t)parts.size();
+        snake.wantsSouth = saved.wantsSouth;
+        snake.dieNextTick = saved.dieNextTick;
+        snake.onBoard = saved.slot >= 0;
+        for (int i = 0; snake.onBoard && i < saved.length; ++i) {
+            int p = saved.part(i);
+            SnapshotPart part;
+            part.x = partStore.cellX[p];
+            part.y = partStore.cellY[p];
+            part.state = partStore.state[p];
+            part.reserved = 0;
+            parts.push_back(part);
+        }
+        snakes.push_back(snake);
+    });
+
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "SNKS", 4);
+    header.version = SNAPSHOT_VERSION;
+    header.headerSize = sizeof(SnapshotHeader);
+    header.boardCols = world.boardCols;
+    header.boardRows = world.boardRows;
+    header.spawnCheckX = world.spawnCheckX;
+    header.spawnCheckY = world.spawnCheckY;
+    header.snakeID = world.snakeID;
+    header.tickNumber = world.tickNumber;
+    header.addSnake = world.addSnake;
+    std::stringstream rngText;
+    rngText << world.rng;
+    rngText >> header.rngState;
+    header.snakeCount = (uint32_t)snakes.size();
+    header.partCount = (uint32_t)parts.size();
+    header.inputCount = inputCount;
+    header.lengthMin = world.lengthRange.min();
+    header.lengthMax = world.lengthRange.max();
+    header.snakesOffset = sizeof(SnapshotHeader);
+    header.partsOffset = header.snakesOffset + snakes.size() * sizeof(SnapshotSnake);
+
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    out.write((const char *)&header, sizeof(header));
+    if (!snakes.empty()) out.write((const char *)&snakes[0], snakes.size() * sizeof(SnapshotSnake));
+    if (!parts.empty()) out.write((const char *)&parts[0], parts.size() * sizeof(SnapshotPart));
+    if (!out) {
+        std::cout << "ERROR: can't write snapshot " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// loadSnapshot() maps path, checks that the header and every Snake fit in the file, and puts world back the way it was saved.
+// The Snakes have to come in increasing id order below snakeID, snakeById() and forEachSnake() count on it.
+// The PartStore slots and occupancyGrid are rebuilt rather than saved, nothing in a tick depends on which slot a Snake has.
+// inputCount gets the snapshot's inputCount
+bool loadSnapshot(World &world, const std::string &path, uint32_t *inputCount) {
+    MappedFile file;
+    if (!file.open(path) || file.size < sizeof(SnapshotHeader)) {
+        std::cout << "ERROR: can't read snapshot " << path << std::endl;
+        return false;
+    }
+    const SnapshotHeader *header = (const SnapshotHeader *)file.data;
+    if (std::memcmp(header->magic, "SNKS", 4) != 0 || header->version != SNAPSHOT_VERSION || header->headerSize != sizeof(SnapshotHeader)) {
+        std::cout << "ERROR: " << path << " is not a version " << SNAPSHOT_VERSION << " snapshot" << std::endl;
+        return false;
+    }
+    if (header->snakesOffset + (uint64_t)header->snakeCount * sizeof(SnapshotSnake) > file.size ||
+        header->partsOffset + (uint64_t)header->partCount * sizeof(SnapshotPart) > file.size ||
+        header->boardCols <= 0 || header->boardRows <= 0 || header->lengthMax > 64) {
+        std::cout << "ERROR: snapshot " << path << " is truncated or corrupt" << std::endl;
+        return false;
+    }
+    const SnapshotSnake *snakes = (const SnapshotSnake *)(file.data + header->snakesOffset);
+    const SnapshotPart  *parts  = (const SnapshotPart *)(file.data + header->partsOffset);
+    for (uint32_t s = 0; s < header->snakeCount; ++s) {
+        if (snakes[s].length < 2 || snakes[s].length > (int)header->lengthMax || snakes[s].direction < NORTH || snakes[s].direction > WEST ||
+            snakes[s].color < GREEN || snakes[s].color > RED ||
+            snakes[s].id < 0 || snakes[s].id >= header->snakeID || (s > 0 && snakes[s].id <= snakes[s - 1].id) ||
+            (snakes[s].onBoard && (snakes[s].firstPart < 0 || (uint32_t)snakes[s].firstPart + snakes[s].length > header->partCount))) {
+            std::cout << "ERROR: snapshot " << path << " has a broken snake" << std::endl;
+            return false;
+        }
+    }
+
+    world.lengthRange = std::uniform_real_distribution <double>(header->lengthMin, header->lengthMax);
+    world.resetSimulation(0, header->boardCols, header->boardRows);
+    world.spawnCheckX = header->spawnCheckX;
+    world.spawnCheckY = header->spawnCheckY;
+    world.snakeID = header->snakeID;
+    world.tickNumber = header->tickNumber;
+    world.addSnake = header->addSnake != 0;
+    *inputCount = header->inputCount;
+    std::stringstream rngText;
+    rngText << header->rngState;
+    rngText >> world.rng;
+
+    PartStore &partStore = world.partStore;
+    world.snakeMasterVec.reserve(header->snakeCount);
+    for (uint32_t s = 0; s < header->snakeCount; ++s) {
+        const SnapshotSnake &saved = snakes[s];
+        world.snakeMasterVec.push_back(Snake(world, saved.id, saved.length, saved.color));
+        Snake &snake = world.snakeMasterVec.back();
+        snake.direction = saved.direction;
+        snake.wantsSouth = saved.wantsSouth != 0;
+        snake.dieNextTick = saved.dieNextTick != 0;
+        if (!saved.onBoard) {
+            partStore.freeSlot(snake.slot);
+            snake.slot = -1;
+            continue;
+        }
+        for (int i = 0; i < snake.length; ++i) {
+            const SnapshotPart &part = parts[saved.firstPart + i];
+            int p = snake.part(i);
+            partStore.cellX[p] = part.x;
+            partStore.cellY[p] = part.y;
+            partStore.state[p] = part.state;
+            world.occupancyGrid.occupy(part.x, part.y, snake.id, snake.color);
+            world.markDirty(part.x, part.y);
+        }
+    }
+    return true;
+}
+
+/******************************************
+*               input logs                *
+*******************************************/
+
+bool InputLog::open(const std::string &path) {
+    out.open(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cout << "ERROR: can't write input log " << path << std::endl;
+        return false;
+    }
+    records = 0;
+    InputLogHeader header;
+    std::memcpy(header.magic, "SNKI", 4);
+    header.version = INPUT_LOG_VERSION;
+    out.write((const char *)&header, sizeof(header));
+    return true;
+}
+
+// record() appends one input and flushes it, inputs are rare and a crashed run is the one worth replaying
+void InputLog::record(int tick, int action) {
+    if (!out.is_open()) return;
+    InputRecord input;
+    input.tickNumber = tick;
+    input.action = action;
+    out.write((const char *)&input, sizeof(input));
+    out.flush();
+    ++records;
+}
+
+// mapInputLog() maps the input log at path into file and returns its records, or nullptr with count 0 if it isn't one
+const InputRecord * mapInputLog(MappedFile &file, const std::string &path, size_t *count) {
+    *count = 0;
+    if (!file.open(path) || file.size < sizeof(InputLogHeader)) {
+        std::cout << "ERROR: can't read input log " << path << std::endl;
+        return nullptr;
+    }
+    const InputLogHeader *header = (const InputLogHeader *)file.data;
+    if (std::memcmp(header->magic, "SNKI", 4) != 0 || header->version != INPUT_LOG_VERSION) {
+        std::cout << "ERROR: " << path << " is not a version " << INPUT_LOG_VERSION << " input log" << std::endl;
+        return nullptr;
+    }
+    *count = (file.size - sizeof(InputLogHeader)) / sizeof(InputRecord);
+    return (const InputRecord *)(file.data + sizeof(InputLogHeader));
+}
+
+// runReplay() loads a snapshot and plays ticks game ticks from it as fast as it can, applying every logged input at the tick it
+// came after. The snapshot's inputCount inputs are already in it and get skipped, so one log goes with every snapshot saved during its run,
+// even one saved between two inputs of the same tick. An inputPath of "-" replays without inputs
+void runReplay(const std::string &snapshotPath, const std::string &inputPath, int ticks, int threadCount) {
+    World world;
+    world.setTickThreads(threadCount);
+    uint32_t savedInputs = 0;
+    if (!loadSnapshot(world, snapshotPath, &savedInputs)) return;
+
+    MappedFile inputFile;
+    size_t inputCount = 0;
+    const InputRecord *inputs = nullptr;
+    if (inputPath != "-") {
+        inputs = mapInputLog(inputFile, inputPath, &inputCount);
+        if (inputs == nullptr) return;
+    }
+    if (savedInputs > inputCount) {
+        std::cout << "ERROR: " << inputPath << " has " << inputCount << " inputs, " << snapshotPath << " was saved after " << savedInputs << std::endl;
+        return;
+    }
+    size_t next = savedInputs;
+    size_t firstInput = next;
+
+    int startTick = world.tickNumber;
+    auto start = std::chrono::steady_clock::now();
+    for (int tick = 0; tick < ticks; ++tick) {
+        for (; next < inputCount && inputs[next].tickNumber == world.tickNumber; ++next) {
+            if (inputs[next].action >= 0 && inputs[next].action < INPUT_ACTION_COUNT) world.applyInput(inputs[next].action);
+        }
+        world.gameTick();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << "replay of " << snapshotPath << " from tick " << startTick << ", board " << world.boardCols << "x" << world.boardRows << ", "
+              << ticks << " ticks, " << threadCount << " threads, " << next - firstInput << " inputs applied" << std::endl;
+    world.printRunSummary(ticks, elapsed.count());
+}
@@ -0,0 +1,132 @@
+#pragma once
+// snapshot.h saves the whole simulation to a compact binary file and loads it back, and logs the player's inputs so a run
+// can be replayed from any saved tick. Both files are read through a memory map: the structs below are the file layout,
+// little endian, so the loader points into the mapping instead of parsing anything
+#include "snakeSim.h"
+#include <string>
+#include <fstream>
+#include <cstddef>
+
+/******************************************
+*           snapshot file layout          *
+*******************************************/
+
+// SNAPSHOT_VERSION goes up whenever one of the structs below changes, older files are refused instead of misread
+uint32_t const SNAPSHOT_VERSION = 2;
+
+// the header is followed by snakeCount SnapshotSnakes at snakesOffset and partCount SnapshotParts at partsOffset.
+// inputCount is how many records the run's input log held when the snapshot was saved, a replay applies the ones after them
+struct SnapshotHeader {
+    char     magic[4];
+    uint32_t version;
+    uint32_t headerSize;
+    int32_t  boardCols;
+    int32_t  boardRows;
+    int32_t  spawnCheckX;
+    int32_t  spawnCheckY;
+    int32_t  snakeID;
+    int32_t  tickNumber;
+    uint32_t addSnake;
+    uint32_t rngState;
+    uint32_t snakeCount;
+    uint32_t partCount;
+    uint32_t inputCount;
+    double   lengthMin;
+    double   lengthMax;
+    uint64_t snakesOffset;
+    uint64_t partsOffset;
+};
+
+// a Snake in id order, its parts are firstPart up to firstPart + length head to tail.
+// A Snake the player removed since the last tick is not onBoard and has no parts
+struct SnapshotSnake {
+    int32_t id;
+    int32_t length;
+    int32_t direction;
+    int32_t color;
+    int32_t firstPart;
+    uint8_t wantsSouth;
+    uint8_t dieNextTick;
+    uint8_t onBoard;
+    uint8_t reserved;
+};
+
+// a SnakePart's cell and its PartStore state byte
+struct SnapshotPart {
+    int16_t x;
+    int16_t y;
+    uint8_t state;
+    uint8_t reserved;
+};
+
+static_assert(sizeof(SnapshotHeader) == 88, "SnapshotHeader is part of the file format");
+static_assert(sizeof(SnapshotSnake) == 24, "SnapshotSnake is part of the file format");
+static_assert(sizeof(SnapshotPart) == 6, "SnapshotPart is part of the file format");
+
+/******************************************
+*          input log file layout          *
+*******************************************/
+
+uint32_t const INPUT_LOG_VERSION = 1;
+
+struct InputLogHeader {
+    char     magic[4];
+    uint32_t version;
+};
+
+// one of the inputActions, applied after tick tickNumber ran and before the next one
+struct InputRecord {
+    int32_t tickNumber;
+    int32_t action;
+};
+
+static_assert(sizeof(InputLogHeader) == 8, "InputLogHeader is part of the file format");
+static_assert(sizeof(InputRecord) == 8, "InputRecord is part of the file format");
+
+/******************************************
+*           MappedFile class              *
+*                                         *
+*  a whole file mapped read only          *
+*******************************************/
+
+struct MappedFile {
+    MappedFile();
+    ~MappedFile();
+    bool open(const std::string &path);
+    void close();
+
+    const unsigned char * data;
+    size_t                size;
+#ifdef _WIN32
+    void *                file;
+    void *                mapping;
+#else
+    int                   fd;
+#endif
+
+private:
+    MappedFile(const MappedFile &);
+    MappedFile & operator=(const MappedFile &);
+};
+
+/******************************************
+*           InputLog class                *
+*                                         *
+*  appends the player's inputs to a file  *
+*******************************************/
+
+// records counts what record() appended, a snapshot saved along the way keeps it as its inputCount
+struct InputLog {
+    InputLog() : records(0) {}
+    bool open(const std::string &path);
+    void record(int tick, int action);
+    bool isOpen() const { return out.is_open(); }
+
+    std::ofstream out;
+    uint32_t      records;
+};
+
+bool saveSnapshot(const World &world, const std::string &path, uint32_t inputCount);
+bool loadSnapshot(World &world, const std::string &path, uint32_t *inputCount);
+const InputRecord * mapInputLog(MappedFile &file, const std::string &path, size_t *count);
+void runReplay(const std::string &snapshotPath, const std::string &inputPath, int ticks, int threadCount);
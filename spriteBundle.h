@@ -0,0 +1,86 @@
+#pragma once
+// spriteBundle.h is the layout of the sprite atlas and of sprites.bundle, every snake sprite already decoded and packed into one atlas by packSprites.
+// The game maps the file and hands the pixels straight to a texture, so it needs neither SDL_image nor the pngs at runtime
+#include "snakeSim.h"
+#include <cstdint>
+
+// the four pngs of every color, the atlas keeps each of them in every orientation
+enum spriteParts { HEAD_SPRITE, BODY_SPRITE, TAIL_SPRITE, CORNER_SPRITE, SPRITE_PART_COUNT };
+
+// Each color gets a row of FRAMES_PER_COLOR frames: the head, body and tail facing NORTH, EAST, SOUTH and WEST,
+// then the corner sprite as each corner from TOP_RIGHT_CORNER to BOTTEM_LEFT_CORNER. Every SnakePart is one plain SDL_RenderCopy of one frame
+constexpr int ORIENTED_PARTS    = 3;
+constexpr int CORNER_FRAME_BASE = ORIENTED_PARTS * 4;
+constexpr int FRAMES_PER_COLOR  = CORNER_FRAME_BASE + 4;
+
+// spriteFrame() returns the atlas frame of a SnakePart: a bent part shows its corner, any other part its sprite facing its direction
+constexpr int spriteFrame(int color, int part, int direction, int corner) {
+    return color * FRAMES_PER_COLOR + (corner != NO_CORNER ? CORNER_FRAME_BASE + corner - TOP_RIGHT_CORNER : part * 4 + direction);
+}
+
+// the pngs are drawn facing WEST, and the corner png is a BOTTEM_LEFT_CORNER
+constexpr int pngFrame(int color, int part) {
+    return part == CORNER_SPRITE ? spriteFrame(color, 0, WEST, BOTTEM_LEFT_CORNER) : spriteFrame(color, part, WEST, NO_CORNER);
+}
+
+// how each orientation is made from its png: degrees clockwise, or SPRITE_FLIP for a horizontal mirror
+constexpr int SPRITE_FLIP = -1;
+constexpr int directionTurns[4] = { 90, SPRITE_FLIP, 270, 0 };
+constexpr int cornerTurns[4]    = { 180, 90, 270, 0 };
+
+// turnFrame() writes frame src of an atlas of 32 bit pixels into frame dst, turned or mirrored
+inline void turnFrame(uint32_t *pixels, int pitchWords, int size, int src, int dst, int turn) {
+    uint32_t *from = pixels + (src / FRAMES_PER_COLOR) * size * pitchWords + (src % FRAMES_PER_COLOR) * size;
+    uint32_t *to   = pixels + (dst / FRAMES_PER_COLOR) * size * pitchWords + (dst % FRAMES_PER_COLOR) * size;
+    int last = size - 1;
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            int sx = x, sy = y;
+            if (turn == 90)               { sx = y;        sy = last - x; }
+            else if (turn == 180)         { sx = last - x; sy = last - y; }
+            else if (turn == 270)         { sx = last - y; sy = x; }
+            else if (turn == SPRITE_FLIP) { sx = last - x; }
+            to[y * pitchWords + x] = from[sy * pitchWords + sx];
+        }
+    }
+}
+
+// bakeOrientations() fills in every frame of an atlas that has the pngs in their pngFrame()s
+inline void bakeOrientations(uint32_t *pixels, int pitchWords, int size) {
+    for (int color = 0; color < SNAKE_COLOR_COUNT; ++color) {
+        for (int part = 0; part < ORIENTED_PARTS; ++part) {
+            for (int direction = NORTH; direction <= WEST; ++direction) {
+                if (direction == WEST) continue;
+                turnFrame(pixels, pitchWords, size, pngFrame(color, part), spriteFrame(color, part, direction, NO_CORNER), directionTurns[direction]);
+            }
+        }
+        for (int corner = TOP_RIGHT_CORNER; corner < BOTTEM_LEFT_CORNER; ++corner) {
+            turnFrame(pixels, pitchWords, size, pngFrame(color, CORNER_SPRITE), spriteFrame(color, 0, NORTH, corner), cornerTurns[corner - TOP_RIGHT_CORNER]);
+        }
+    }
+}
+
+// SPRITE_BUNDLE_VERSION goes up whenever SpriteBundleHeader or the pixel layout changes
+uint32_t const SPRITE_BUNDLE_VERSION = 2;
+
+// the header is followed at pixelsOffset by height rows of pitch bytes, each pixel a 32 bit ARGB word (SDL_PIXELFORMAT_ARGB8888), little endian
+struct SpriteBundleHeader {
+    char     magic[4];
+    uint32_t version;
+    uint32_t frameSize;
+    uint32_t frameCols;
+    uint32_t frameRows;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pitch;
+    uint64_t pixelsOffset;
+};
+
+static_assert(sizeof(SpriteBundleHeader) == 40, "SpriteBundleHeader is part of the file format");
+
+// the pngs packSprites packs and the game loads itself when there is no bundle, in spriteParts order
+static char const *const spriteBundleFiles[SNAKE_COLOR_COUNT][SPRITE_PART_COUNT] = {
+    { "greenHead.png", "greenBody.png", "greenTail.png", "greenBodyCorner.png" },
+    { "blueHead.png",  "blueBody.png",  "blueTail.png",  "blueBodyCorner.png"  },
+    { "redHead.png",   "redBody.png",   "redTail.png",   "redBodyCorner.png"   },
+};